@@ -5,46 +5,454 @@
 //    it. Test them."
 //
 // I tried to emulate the interface a "real" library the best I could; this
-// source file contains the both the library itself and a modest test suite.
+// source file contains the both the library itself, a modest test suite and a
+// few benchmarks (run with the 'bench' argument).
 //
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIST_LIB_X86 1
+#endif
+
 // =========== List definition and API start =========== //
 
+// Where the memory behind a node came from; decides how it is released.
+typedef enum {
+    NODE_HEAP,   // make_node: node and data are separate mallocs
+    NODE_POOL,   // node_pool_make_node: node lives in a NodePool slab
+    NODE_INLINE, // make_node_inline: data is stored right after the node
+    NODE_ARENA,  // init_list_arena: in one of the ArenaBlocks of its list
+    NODE_CACHED, // make_node_cached: node and data share a NodeCache block
+    NODE_BATCH   // insert_batch_*: shares a BatchBlock with its whole batch
+} NodeKind;
+
+// 'len' and 'hash' describe 'data' and are filled in by the node
+// constructors; the string must not be modified in place afterwards.
 typedef struct Node Node;
 struct Node {
     Node *prev;
     Node *next;
     char *data;
+    size_t len;    // strlen(data)
+    uint32_t hash; // hash_bytes(data, len)
+    unsigned char kind;
+    unsigned char checkpoint; // starts a find_parallel segment
+    unsigned char size_class; // NODE_CACHED only
+    unsigned char hits;       // find_adaptive hits under ORGANIZE_COUNT
+};
+
+// Nodes are carved out of fixed-size slabs. Released nodes are threaded onto
+// an intrusive free list through their 'next' pointer, so getting and putting
+// a node never touches the system allocator once the slabs are warm.
+#define NODE_POOL_SLAB_LEN 256
+
+typedef struct NodeSlab NodeSlab;
+struct NodeSlab {
+    NodeSlab *next;
+    Node nodes[NODE_POOL_SLAB_LEN];
+};
+
+typedef struct {
+    NodeSlab *slabs;
+    Node *free_list;
+} NodePool;
+
+// Open-addressing (linear probing) map from string contents to the nodes
+// holding them. Every node of the list has exactly one slot, so duplicate
+// strings occupy several slots.
+typedef struct {
+    Node **slots;    // NULL is empty, HASH_INDEX_TOMBSTONE is a deleted slot
+    size_t capacity; // always a power of two
+    size_t count;    // live entries
+    size_t used;     // live entries plus tombstones
+} HashIndex;
+
+// One contiguous allocation holding a batch of nodes followed by their
+// strings. Arena nodes are never freed individually; the blocks go away all
+// at once in dealloc_list.
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+    ArenaBlock *next;
+    Node nodes[];
+};
+
+// One contiguous allocation holding a batch of nodes followed by their
+// strings, each string preceded by a pointer back to the block. Unlike an
+// ArenaBlock it belongs to no list: its nodes are released one by one like
+// any other, and the last release frees the block.
+typedef struct {
+    size_t live; // nodes not yet released
+    Node nodes[];
+} BatchBlock;
+
+// Indexable skip list over the nodes of a List, for positional access. The
+// Node chain itself is the bottom level; a node gets a SkipEntry only if it
+// reaches level 1 or above. Each link records how many nodes it spans.
+#define SKIP_MAX_LEVEL 16
+#define SKIP_FANOUT 4
+
+typedef struct SkipEntry SkipEntry;
+struct SkipEntry {
+    Node *node; // NULL for the header
+    int height;
+    struct {
+        SkipEntry *next;
+        size_t width;
+    } link[]; // link[l] is level l + 1
 };
 
+typedef struct {
+    SkipEntry *header; // stands before the list head, SKIP_MAX_LEVEL links
+    int level;         // highest level in use
+    int stale;         // set by mutations other than insert_at, remove_at
+    size_t walked;     // nodes walked by list_at while stale
+    uint64_t seed;
+} SkipIndex;
+
+// Every 'stride'-th node of the list, recorded so that a walk can be split
+// into segments without walking to the split points first. Segment 0 runs
+// from the head to nodes[0], segment i from nodes[i - 1] to nodes[i]. Inserts
+// only lengthen segments; removing a checkpoint node or reordering the list
+// makes the array stale.
+typedef struct {
+    Node **nodes;
+    size_t count;
+    size_t capacity;
+    size_t stride;
+    size_t built_size; // list size at the last rebuild
+    int stale;
+} Checkpoints;
+
+// How find_adaptive moves a hit toward the head of its list
+typedef enum {
+    ORGANIZE_NONE,          // leave the order alone
+    ORGANIZE_MOVE_TO_FRONT, // move the hit to the head
+    ORGANIZE_TRANSPOSE,     // swap the hit with its predecessor
+    ORGANIZE_COUNT          // keep nodes ordered by their hit counts
+} OrganizePolicy;
+
 typedef struct {
     Node *head;
     Node *last;
+    size_t size;
+    NodePool *pool;    // where NODE_POOL nodes are returned; may be NULL
+    HashIndex *index;  // optional, see list_index_attach; may be NULL
+    SkipIndex *skip;   // optional, see list_skip_attach; may be NULL
+    ArenaBlock *arena; // blocks backing NODE_ARENA nodes; may be NULL
+    Checkpoints *checkpoints; // optional, see list_checkpoints_attach
+    unsigned char organize;   // OrganizePolicy applied by find_adaptive
 } List;
 
 // Crude error reporting system; these definitions and functions would be
 // 'static' if the library was in its own file.
+// Error values start at 1 so that they can never be mistaken for success.
 typedef enum {
-    ALLOC_FAIL,
+    ALLOC_FAIL = 1,
     LEN_INVALID,
-    NULL_PTR
+    NULL_PTR,
+    INDEX_INVALID,
+    NOT_FOUND,
+    DUPLICATE,
+    OWNER_MISMATCH
 } Error;
 const char *ERROR[] = {
-    "Dynamic memory allocation failed.",
-    "Tried to initialize something with negative length.",
-    "Function received null pointer argument."
+    [ALLOC_FAIL] = "Dynamic memory allocation failed.",
+    [LEN_INVALID] = "Tried to initialize something with negative length.",
+    [NULL_PTR] = "Function received null pointer argument.",
+    [INDEX_INVALID] = "Function received an index that is out of range.",
+    [NOT_FOUND] = "No node holds the requested contents.",
+    [DUPLICATE] = "A node with the same contents already exists.",
+    [OWNER_MISMATCH] = "Nodes can't move to a list that can't release them."
 };
 void print_error(Error e)
 {
     fprintf(stderr, "list_lib error: %s\n", ERROR[e]);
 }
 
+// 32-bit FNV-1a hash of 'len' bytes at 'data'
+uint32_t hash_bytes(const char *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Byte comparison kernels. All of them compare exactly 'len' bytes and never
+// read past them, which is safe because nodes know their length; strcmp has
+// to look for the terminator byte by byte instead.
+typedef int (*BytesEqualFn)(const char *a, const char *b, size_t len);
+
+int bytes_equal_scalar(const char *a, const char *b, size_t len)
+{
+    return memcmp(a, b, len) == 0;
+}
+
+#ifdef LIST_LIB_X86
+__attribute__((target("sse2")))
+int bytes_equal_sse2(const char *a, const char *b, size_t len)
+{
+    if (len < 16) {
+        if (len < 8)
+            return memcmp(a, b, len) == 0;
+        // Two overlapping 8 byte words cover 8 to 15 bytes
+        uint64_t x0, y0, x1, y1;
+        memcpy(&x0, a, 8);
+        memcpy(&y0, b, 8);
+        memcpy(&x1, a + len - 8, 8);
+        memcpy(&y1, b + len - 8, 8);
+        return ((x0 ^ y0) | (x1 ^ y1)) == 0;
+    }
+    size_t i;
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+            return 0;
+    }
+    if (i == len)
+        return 1;
+    // Overlap the last block with the previous one instead of a scalar tail
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + len - 16));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + len - 16));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+int bytes_equal_avx2(const char *a, const char *b, size_t len)
+{
+    if (len < 32)
+        return bytes_equal_sse2(a, b, len);
+    size_t i;
+    // Two blocks per iteration, merged before the single movemask
+    for (i = 0; i + 64 <= len; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y0 = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 32));
+        __m256i y1 = _mm256_loadu_si256((const __m256i *)(b + i + 32));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(x0, y0),
+                                      _mm256_cmpeq_epi8(x1, y1));
+        if ((unsigned)_mm256_movemask_epi8(eq) != 0xFFFFFFFFu)
+            return 0;
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))
+            != 0xFFFFFFFFu)
+            return 0;
+    }
+    if (i == len)
+        return 1;
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + len - 32));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + len - 32));
+    return (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))
+           == 0xFFFFFFFFu;
+}
+#endif
+
+// Pick the widest kernel this CPU supports
+BytesEqualFn select_bytes_equal()
+{
+#ifdef LIST_LIB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return bytes_equal_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return bytes_equal_sse2;
+#endif
+    return bytes_equal_scalar;
+}
+
+int bytes_equal_detect(const char *a, const char *b, size_t len);
+
+// Starts out pointing at bytes_equal_detect, which replaces it on first use
+BytesEqualFn bytes_equal_impl = bytes_equal_detect;
+
+int bytes_equal_detect(const char *a, const char *b, size_t len)
+{
+    BytesEqualFn fn = select_bytes_equal();
+    __atomic_store_n(&bytes_equal_impl, fn, __ATOMIC_RELAXED);
+    return fn(a, b, len);
+}
+
+// Whether the 'len' bytes at 'a' and 'b' are equal, using the best kernel
+int bytes_equal(const char *a, const char *b, size_t len)
+{
+    return __atomic_load_n(&bytes_equal_impl, __ATOMIC_RELAXED)(a, b, len);
+}
+
+// Fill in the cached length and hash of a node whose 'data' is set
+void node_set_key(Node *node, size_t len)
+{
+    node->len = len;
+    node->hash = hash_bytes(node->data, len);
+}
+
+// Whether 'node' holds the 'len' bytes at 'data' hashing to 'hash'. Nodes
+// that don't match are almost always rejected by the first comparison.
+int node_key_equal(const Node *node, const char *data, size_t len,
+                   uint32_t hash)
+{
+    return node->hash == hash && node->len == len
+           && bytes_equal(node->data, data, len);
+}
+
+#define HASH_INDEX_MIN_CAPACITY 16
+// Marks a slot whose node was removed; probing continues past it
+#define HASH_INDEX_TOMBSTONE ((Node *)&hash_index_tombstone)
+char hash_index_tombstone;
+
+// Rebuild 'index' with room for 'capacity' slots, dropping tombstones.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hash_index_resize(HashIndex *index, size_t capacity)
+{
+    Node **slots = calloc(capacity, sizeof(*slots));
+    if (slots == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    size_t i;
+    for (i = 0; i < index->capacity; ++i) {
+        Node *n = index->slots[i];
+        if (n == NULL || n == HASH_INDEX_TOMBSTONE)
+            continue;
+        size_t j = n->hash & (capacity - 1);
+        while (slots[j] != NULL)
+            j = (j + 1) & (capacity - 1);
+        slots[j] = n;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    index->used = index->count;
+    return 0;
+}
+
+// Add 'node' to 'index', growing it to keep the load factor at or below 1/2.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hash_index_add(HashIndex *index, Node *node)
+{
+    if ((index->used + 1) * 2 > index->capacity) {
+        size_t capacity = index->capacity;
+        // Only grow if live entries, not tombstones, are filling the table
+        if ((index->count + 1) * 4 > capacity)
+            capacity *= 2;
+        int ret = hash_index_resize(index, capacity);
+        if (ret != 0)
+            return ret;
+    }
+    size_t mask = index->capacity - 1;
+    size_t i = node->hash & mask;
+    while (index->slots[i] != NULL && index->slots[i] != HASH_INDEX_TOMBSTONE)
+        i = (i + 1) & mask;
+    if (index->slots[i] == NULL)
+        ++index->used;
+    index->slots[i] = node;
+    ++index->count;
+    return 0;
+}
+
+// Remove 'node' (the node itself, not just its contents) from 'index'
+void hash_index_remove(HashIndex *index, Node *node)
+{
+    size_t mask = index->capacity - 1;
+    size_t i = node->hash & mask;
+    while (index->slots[i] != NULL) {
+        if (index->slots[i] == node) {
+            index->slots[i] = HASH_INDEX_TOMBSTONE;
+            --index->count;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// Look up the 'len' bytes at 'data', hashing to 'hash', in 'index'. Sets
+// '*matches' to the number of nodes holding them (stopping at 2) and returns
+// one of those nodes, or NULL if there are none.
+Node *hash_index_lookup(const HashIndex *index, const char *data, size_t len,
+                        uint32_t hash, int *matches)
+{
+    size_t mask = index->capacity - 1;
+    size_t i = hash & mask;
+    Node *found = NULL;
+    *matches = 0;
+    while (index->slots[i] != NULL && *matches < 2) {
+        Node *n = index->slots[i];
+        if (n != HASH_INDEX_TOMBSTONE && node_key_equal(n, data, len, hash)) {
+            found = n;
+            ++*matches;
+        }
+        i = (i + 1) & mask;
+    }
+    return found;
+}
+
+// Bookkeeping for a node about to be linked into 'list'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_track_link(List *list, Node *node)
+{
+    node->checkpoint = 0;
+    node->hits = 0;
+    if (list->index != NULL) {
+        int ret = hash_index_add(list->index, node);
+        if (ret != 0)
+            return ret;
+    }
+    if (list->skip != NULL)
+        list->skip->stale = 1;
+    ++list->size;
+    return 0;
+}
+
+// Bookkeeping for a node that was just unlinked from 'list'
+void list_track_unlink(List *list, Node *node)
+{
+    if (list->index != NULL)
+        hash_index_remove(list->index, node);
+    if (list->skip != NULL)
+        list->skip->stale = 1;
+    if (node->checkpoint && list->checkpoints != NULL)
+        list->checkpoints->stale = 1;
+    --list->size;
+}
+
+// Bookkeeping after the nodes of 'list' were put in a different order
+void list_track_reorder(List *list)
+{
+    if (list->skip != NULL)
+        list->skip->stale = 1;
+    if (list->checkpoints != NULL)
+        list->checkpoints->stale = 1;
+}
+
+// Forward links ('head' and 'next') are written with release stores, after
+// the node being published is fully set up. That lets find_concurrent walk a
+// list while a single writer changes it.
+#define LINK_PUBLISH(link, node) \
+    __atomic_store_n(&(link), (node), __ATOMIC_RELEASE)
+#define LINK_READ(link) __atomic_load_n(&(link), __ATOMIC_ACQUIRE)
+
 // Inserts 'new_node' into 'list' after 'node'.
 // Returns 0 if successful.
 // Returns an error enum if unsuccessful.
@@ -54,6 +462,9 @@ int insert_after(List *list, Node *node, Node *new_node)
         print_error(NULL_PTR);
         return NULL_PTR;
     }
+    int ret = list_track_link(list, new_node);
+    if (ret != 0)
+        return ret;
 
     new_node->prev = node;
     if (node->next == NULL) {
@@ -63,7 +474,7 @@ int insert_after(List *list, Node *node, Node *new_node)
         new_node->next = node->next;
         node->next->prev = new_node;
     }
-    node->next = new_node;
+    LINK_PUBLISH(node->next, new_node);
 
     return 0;
 }
@@ -77,14 +488,17 @@ int insert_before(List *list, Node *node, Node *new_node)
         print_error(NULL_PTR);
         return NULL_PTR;
     }
+    int ret = list_track_link(list, new_node);
+    if (ret != 0)
+        return ret;
 
     new_node->next = node;
     if (node->prev == NULL) {
         new_node->prev = NULL;
-        list->head = new_node;
+        LINK_PUBLISH(list->head, new_node);
     } else {
         new_node->prev = node->prev;
-        node->prev->next = new_node;
+        LINK_PUBLISH(node->prev->next, new_node);
     }
     node->prev = new_node;
 
@@ -102,15 +516,17 @@ int insert_front(List *list, Node *new_node)
     }
 
     if (list->head == NULL) {
-        list->head = new_node;
-        list->last = new_node;
+        int ret = list_track_link(list, new_node);
+        if (ret != 0)
+            return ret;
         new_node->prev = NULL;
         new_node->next = NULL;
-    } else {
-        insert_before(list, list->head, new_node);
+        list->last = new_node;
+        LINK_PUBLISH(list->head, new_node);
+        return 0;
     }
 
-    return 0;
+    return insert_before(list, list->head, new_node);
 }
 
 // Inserts 'new_node' at the end of the list.
@@ -123,402 +539,8173 @@ int insert_end(List *list, Node *new_node)
         return NULL_PTR;
     }
 
-    if (list->last == NULL) {
-        insert_front(list, new_node);
-    } else {
-        insert_after(list, list->last, new_node);
-    }
-
-    return 0;
+    if (list->last == NULL)
+        return insert_front(list, new_node);
+    return insert_after(list, list->last, new_node);
 }
 
-// Removes 'node' from 'list'
-// Returns 0 if successful.
-// Returns an error enum if unsuccessful.
-int remove_node(List *list, Node *node)
+// Initialize an empty node pool. No memory is allocated until the first
+// node is requested.
+void node_pool_init(NodePool *pool)
 {
-    if (list == NULL || node == NULL) {
-        print_error(NULL_PTR);
-        return NULL_PTR;
-    }
-
-    // Case: 'node' is list head
-    if (node->prev == NULL) {
-        list->head = node->next;
-    } else {
-        node->prev->next = node->next;
-    }
-    // Case: 'node' is list last
-    if (node->next == NULL) {
-        list->last = node->prev;
-    } else {
-        node->next->prev = node->prev;
-    }
-
-    free(node->data);
-    free(node);
-    return 0;
+    pool->slabs = NULL;
+    pool->free_list = NULL;
 }
 
-// Find a node in 'list' with contents 'data'.
-// Return pointer to node if found.
-// Return NULL if not found or if given arguments are NULL.
-Node *find(const List *list, const char *data)
+// Pop a node off the pool's free list, growing the pool by one slab if the
+// free list is empty.
+// Returns pointer to node if successful.
+// Return NULL if unsuccessful.
+Node *node_pool_get(NodePool *pool)
 {
-    if (list == NULL || data == NULL) {
-        print_error(NULL_PTR);
-        return NULL;
+    if (pool->free_list == NULL) {
+        NodeSlab *slab = malloc(sizeof(*slab));
+        if (slab == NULL) {
+            print_error(ALLOC_FAIL);
+            return NULL;
+        }
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        int i;
+        for (i = NODE_POOL_SLAB_LEN - 1; i >= 0; --i) {
+            slab->nodes[i].next = pool->free_list;
+            pool->free_list = &slab->nodes[i];
+        }
     }
+    Node *node = pool->free_list;
+    pool->free_list = node->next;
+    return node;
+}
 
-    Node *i = list->head;
-    while (i != NULL) {
-        if (strcmp(i->data, data) == 0)
-            return i;
-        i = i->next;
-    }
-    return NULL;
+// Push 'node' back onto the pool's free list.
+void node_pool_put(NodePool *pool, Node *node)
+{
+    node->next = pool->free_list;
+    pool->free_list = node;
 }
 
-// Allocate a new node with 'data' payload
+// Allocate a new node with 'data' payload from 'pool'. Only the string copy
+// goes through malloc.
 // Returns pointer to new node if successful.
 // Return NULL if unsuccessful.
-Node *make_node(const char *data)
+Node *node_pool_make_node(NodePool *pool, const char *data)
 {
-    Node *new_node = malloc(sizeof(*new_node));
-    if (new_node == NULL) {
-        print_error(ALLOC_FAIL);
+    if (pool == NULL || data == NULL) {
+        print_error(NULL_PTR);
         return NULL;
     }
+    Node *new_node = node_pool_get(pool);
+    if (new_node == NULL)
+        return NULL;
     size_t bytes = strlen(data) + 1;
     new_node->data = malloc(sizeof(*new_node->data) * bytes);
     if (new_node->data == NULL) {
         print_error(ALLOC_FAIL);
-        free(new_node);
+        node_pool_put(pool, new_node);
         return NULL;
     }
     new_node->next = NULL;
     new_node->prev = NULL;
-    strcpy(new_node->data, data);
+    new_node->kind = NODE_POOL;
+    new_node->checkpoint = 0;
+    memcpy(new_node->data, data, bytes);
+    node_set_key(new_node, bytes - 1);
     return new_node;
 }
 
-// Deallocate all dynamic memory associated with 'list'
-void dealloc_list(List *list)
+// Free every slab owned by 'pool'. All lists drawing from the pool must have
+// been deallocated first.
+void node_pool_dealloc(NodePool *pool)
 {
-    if (list == NULL) {
+    if (pool == NULL)
         return;
-    }
-    Node *i = list->head;
+    NodeSlab *i = pool->slabs;
     while (i != NULL) {
-        Node *tmp = i->next;
-        free(i->data);
+        NodeSlab *tmp = i->next;
         free(i);
         i = tmp;
     }
+    node_pool_init(pool);
 }
 
-// Attempts to dynamically allocate 'data_len' Node objects for 'list'.
-// You must provide a static array of string data that will be copied into the
-// newly allocated data structure.
-// Returns 0 if successful.
-// Returns an error enum if unsuccessful.
-int init_list(List *list, const char *data[], int data_len)
-{
-    if (data == NULL) {
-        print_error(NULL_PTR);
-        return NULL_PTR;
-    }
-    if (data_len < 0) {
-        print_error(LEN_INVALID);
-        return LEN_INVALID;
-    }
-
-    list->head = NULL;
-    list->last = NULL;
-
-    // Allocate each node
-    int i;
-    for (i = 0; i < data_len; ++i) {
-        Node *new_node = make_node(data[i]);
-        if (new_node == NULL) {
-            dealloc_list(list);
-            return ALLOC_FAIL;
-        }
-        insert_end(list, new_node);
-    }
-
-    return 0;
-}
-
-// =========== List definition and API end =========== //
+// Per-thread caches of node blocks for make_node_cached, after tcmalloc:
+// each block holds a Node and its string, rounded up to one of a few size
+// classes. A thread allocates from and frees to its own cache without any
+// locking; only when a cache runs dry or overfills does it trade a whole
+// batch of blocks with the global depot, which has one lock per size class.
+// Caches are flushed to the depot when their thread exits.
+#define NODE_CACHE_CLASSES 5      // string capacities 16, 32, ... 256 bytes
+#define NODE_CACHE_MIN_BYTES 16
+#define NODE_CACHE_BATCH 32
+#define NODE_CACHE_MAX (2 * NODE_CACHE_BATCH)
 
+typedef struct {
+    Node *free[NODE_CACHE_CLASSES]; // chained through 'next'
+    int count[NODE_CACHE_CLASSES];
+    int registered;                 // flushed by node_cache_key at exit
+} NodeCache;
 
-// =========== List test functions start =========== //
+// Batches are chained through the 'prev' pointer of their first block,
+// which also keeps the batch length in 'len'
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    Node *batches;
+} NodeDepot;
 
-const char *TEST_DATA[] = {
-    "ABC0",
-    "ABC1",
-    "ABC2",
-    "ABC3",
-    "ABC4",
-    "ABC5",
-    "ABC6",
-    "ABC7",
-    "ABC8",
-    "ABC9"
+_Thread_local NodeCache node_cache;
+NodeDepot node_depot[NODE_CACHE_CLASSES] = {
+    { PTHREAD_MUTEX_INITIALIZER, NULL }, { PTHREAD_MUTEX_INITIALIZER, NULL },
+    { PTHREAD_MUTEX_INITIALIZER, NULL }, { PTHREAD_MUTEX_INITIALIZER, NULL },
+    { PTHREAD_MUTEX_INITIALIZER, NULL }
 };
+pthread_key_t node_cache_key;
+pthread_once_t node_cache_once = PTHREAD_ONCE_INIT;
 
-const char **TEST_DATA_NULL = NULL;
-
-const int DATA_LEN = sizeof(TEST_DATA) / sizeof(TEST_DATA[0]);
-const int DATA_LEN_NEGATIVE = -DATA_LEN;
-
-void test_print_list(List *list)
+// Size class whose blocks fit a string of 'bytes' bytes, or -1 if none does
+int node_cache_class(size_t bytes)
 {
-    Node *i = list->head;
-    puts("==== List start ====");
-    while (i != NULL) {
-        puts(i->data);
-        i = i->next;
+    int c = 0;
+    size_t capacity = NODE_CACHE_MIN_BYTES;
+    while (capacity < bytes) {
+        capacity *= 2;
+        if (++c == NODE_CACHE_CLASSES)
+            return -1;
     }
-    puts("==== List end ====");
+    return c;
 }
 
-// For comparing integer values
-void assert_int_equal(int expected, int actual, const char *test_name)
+// Push the 'count' blocks chained from 'first' onto the depot of class 'c'
+void node_depot_put(int c, Node *first, size_t count)
 {
-    printf("%s: ", test_name);
-    if (actual != expected)
-        printf("FAIL: expected %d, got %d\n", expected, actual);
-    else
-        printf("PASS\n");
+    first->len = count;
+    pthread_mutex_lock(&node_depot[c].lock);
+    first->prev = node_depot[c].batches;
+    node_depot[c].batches = first;
+    pthread_mutex_unlock(&node_depot[c].lock);
 }
 
-// For comparing Node pointer values
-void assert_node_ptr_equal(Node *expected, Node *actual, const char *test_name)
+// Hand every block cached by the calling thread to the depot. Runs
+// automatically when a thread that used make_node_cached exits.
+void node_cache_flush(void)
 {
-    printf("%s: ", test_name);
-    if (actual != expected)
-        printf("FAIL: expected %p, got %p\n", expected, actual);
-    else
-        printf("PASS\n");
+    NodeCache *cache = &node_cache;
+    int c;
+    for (c = 0; c < NODE_CACHE_CLASSES; ++c) {
+        if (cache->free[c] != NULL)
+            node_depot_put(c, cache->free[c], cache->count[c]);
+        cache->free[c] = NULL;
+        cache->count[c] = 0;
+    }
 }
 
-// Call init_list with NULL 'data' argument
-void test_init_list_null_data()
+void node_cache_exit(void *arg)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA_NULL, DATA_LEN);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(NULL_PTR, init_ret, "test_init_list_null_data");
+    (void)arg;
+    node_cache_flush();
 }
 
-// Call init_list with negative 'data_len' argument
-void test_init_list_negative_data_len()
+void node_cache_make_key(void)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN_NEGATIVE);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(LEN_INVALID, init_ret, "test_init_list_negative_data_len");
+    pthread_key_create(&node_cache_key, node_cache_exit);
 }
 
-// Call init_list with NULL 'data' argument
-void test_init_list_success()
+// Make sure the calling thread's cache is flushed when the thread exits.
+// Both node_cache_get and node_cache_put need it: a thread may only ever
+// free blocks that other threads allocated.
+NodeCache *node_cache_register(void)
 {
+    NodeCache *cache = &node_cache;
+    if (!cache->registered) {
+        pthread_once(&node_cache_once, node_cache_make_key);
+        pthread_setspecific(node_cache_key, cache);
+        cache->registered = 1;
+    }
+    return cache;
+}
+
+// Free every block held by the depot. Blocks still cached by threads are
+// not affected.
+void node_cache_trim(void)
+{
+    int c;
+    for (c = 0; c < NODE_CACHE_CLASSES; ++c) {
+        pthread_mutex_lock(&node_depot[c].lock);
+        Node *batch = node_depot[c].batches;
+        node_depot[c].batches = NULL;
+        pthread_mutex_unlock(&node_depot[c].lock);
+        while (batch != NULL) {
+            Node *next_batch = batch->prev;
+            Node *n = batch;
+            while (n != NULL) {
+                Node *tmp = n->next;
+                free(n);
+                n = tmp;
+            }
+            batch = next_batch;
+        }
+    }
+}
+
+// Get a block of class 'c' from the calling thread's cache, refilling it
+// from the depot or malloc when empty.
+// Returns NULL if out of memory.
+Node *node_cache_get(int c)
+{
+    NodeCache *cache = node_cache_register();
+    if (cache->free[c] == NULL) {
+        pthread_mutex_lock(&node_depot[c].lock);
+        Node *batch = node_depot[c].batches;
+        if (batch != NULL)
+            node_depot[c].batches = batch->prev;
+        pthread_mutex_unlock(&node_depot[c].lock);
+        if (batch != NULL) {
+            cache->free[c] = batch;
+            cache->count[c] = (int)batch->len;
+        }
+    }
+    Node *n = cache->free[c];
+    if (n != NULL) {
+        cache->free[c] = n->next;
+        --cache->count[c];
+        return n;
+    }
+    n = malloc(sizeof(*n) + ((size_t)NODE_CACHE_MIN_BYTES << c));
+    if (n == NULL)
+        print_error(ALLOC_FAIL);
+    return n;
+}
+
+// Return a NODE_CACHED block to the calling thread's cache, passing a batch
+// on to the depot if the cache is over its limit
+void node_cache_put(Node *node)
+{
+    NodeCache *cache = node_cache_register();
+    int c = node->size_class;
+    node->next = cache->free[c];
+    cache->free[c] = node;
+    if (++cache->count[c] <= NODE_CACHE_MAX)
+        return;
+    Node *first = cache->free[c];
+    Node *last = first;
+    int i;
+    for (i = 1; i < NODE_CACHE_BATCH; ++i)
+        last = last->next;
+    cache->free[c] = last->next;
+    cache->count[c] -= NODE_CACHE_BATCH;
+    last->next = NULL;
+    node_depot_put(c, first, NODE_CACHE_BATCH);
+}
+
+// Bytes taken in a BatchBlock by the back pointer and string of a node
+// whose string is 'len' bytes long, keeping the next back pointer aligned
+size_t batch_slot_bytes(size_t len)
+{
+    size_t align = _Alignof(BatchBlock *);
+    return sizeof(BatchBlock *) + ((len + align) & ~(align - 1));
+}
+
+BatchBlock *batch_block_of(const Node *node)
+{
+    return ((BatchBlock **)node->data)[-1];
+}
+
+// Drop the hold of NODE_BATCH 'node' on its block, freeing the block if it
+// was the last. Nodes of one batch may be released by different threads.
+void batch_block_release(Node *node)
+{
+    BatchBlock *block = batch_block_of(node);
+    if (__atomic_sub_fetch(&block->live, 1, __ATOMIC_ACQ_REL) == 0)
+        free(block);
+}
+
+// Give the memory behind 'node' back to wherever it came from. 'node' must
+// already be unlinked from 'list'.
+void release_node(List *list, Node *node)
+{
+    switch (node->kind) {
+    case NODE_POOL:
+        free(node->data);
+        node_pool_put(list->pool, node);
+        break;
+    case NODE_INLINE:
+        free(node);
+        break;
+    case NODE_ARENA:
+        // Reclaimed with the rest of its block by dealloc_list
+        break;
+    case NODE_CACHED:
+        node_cache_put(node);
+        break;
+    case NODE_BATCH:
+        batch_block_release(node);
+        break;
+    default:
+        free(node->data);
+        free(node);
+    }
+}
+
+// Unlinks 'node' from 'list' without releasing its memory; the node keeps
+// its stale 'prev' and 'next' pointers.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int unlink_node(List *list, Node *node)
+{
+    if (list == NULL || node == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+
+    // Case: 'node' is list head
+    if (node->prev == NULL) {
+        LINK_PUBLISH(list->head, node->next);
+    } else {
+        LINK_PUBLISH(node->prev->next, node->next);
+    }
+    // Case: 'node' is list last
+    if (node->next == NULL) {
+        list->last = node->prev;
+    } else {
+        node->next->prev = node->prev;
+    }
+
+    list_track_unlink(list, node);
+    return 0;
+}
+
+// Removes 'node' from 'list'
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int remove_node(List *list, Node *node)
+{
+    int ret = unlink_node(list, node);
+    if (ret != 0)
+        return ret;
+    release_node(list, node);
+    return 0;
+}
+
+// Relink 'node' of 'list' so that it sits just before 'pos', which comes
+// earlier in the same list. Nothing is allocated and the size and hash
+// index are unaffected.
+void list_move_before(List *list, Node *node, Node *pos)
+{
+    // Cut 'node' out; it is never the head since 'pos' precedes it
+    LINK_PUBLISH(node->prev->next, node->next);
+    if (node->next == NULL)
+        list->last = node->prev;
+    else
+        node->next->prev = node->prev;
+
+    node->prev = pos->prev;
+    node->next = pos;
+    pos->prev = node;
+    if (node->prev == NULL)
+        LINK_PUBLISH(list->head, node);
+    else
+        LINK_PUBLISH(node->prev->next, node);
+
+    // Checkpoints stay valid unless one of them moved
+    if (list->skip != NULL)
+        list->skip->stale = 1;
+    if (node->checkpoint && list->checkpoints != NULL)
+        list->checkpoints->stale = 1;
+}
+
+// Find a node in 'list' with contents 'data'. With an index attached this is
+// O(1) on average; if several nodes share 'data' the first one in list order
+// is still returned, at the cost of a walk.
+// Return pointer to node if found.
+// Return NULL if not found or if given arguments are NULL.
+Node *find(const List *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+
+    size_t len = strlen(data);
+    uint32_t hash = hash_bytes(data, len);
+    if (list->index != NULL) {
+        int matches;
+        Node *hit = hash_index_lookup(list->index, data, len, hash, &matches);
+        if (matches < 2)
+            return hit;
+    }
+
+    Node *i = list->head;
+    while (i != NULL) {
+        if (node_key_equal(i, data, len, hash))
+            return i;
+        i = i->next;
+    }
+    return NULL;
+}
+
+// Choose how find_adaptive reorders 'list' after a hit.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_set_organize(List *list, OrganizePolicy policy)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (policy == ORGANIZE_COUNT && list->organize != ORGANIZE_COUNT) {
+        Node *i;
+        for (i = list->head; i != NULL; i = i->next)
+            i->hits = 0;
+    }
+    list->organize = policy;
+    return 0;
+}
+
+// Like find, but a hit is then moved toward the head according to the
+// list's OrganizePolicy, so that frequently found strings get cheaper to
+// find. Since it writes, it must not run concurrently with other finds.
+// Return pointer to node if found.
+// Return NULL if not found or if given arguments are NULL.
+Node *find_adaptive(List *list, const char *data)
+{
+    Node *hit = find(list, data);
+    if (hit == NULL)
+        return NULL;
+
+    switch (list->organize) {
+    case ORGANIZE_MOVE_TO_FRONT:
+        if (hit != list->head)
+            list_move_before(list, hit, list->head);
+        break;
+    case ORGANIZE_TRANSPOSE:
+        if (hit != list->head)
+            list_move_before(list, hit, hit->prev);
+        break;
+    case ORGANIZE_COUNT: {
+        if (hit->hits == UCHAR_MAX) {
+            // Age every count so that old favourites can be overtaken
+            Node *i;
+            for (i = list->head; i != NULL; i = i->next)
+                i->hits /= 2;
+        }
+        ++hit->hits;
+        Node *pos = hit;
+        while (pos->prev != NULL && pos->prev->hits < hit->hits)
+            pos = pos->prev;
+        if (pos != hit)
+            list_move_before(list, hit, pos);
+        break;
+    }
+    default:
+        break;
+    }
+    return hit;
+}
+
+// Collect up to 'max' nodes of 'list' whose contents start with 'prefix' into
+// 'out', in list order. Nodes shorter than the prefix are skipped on their
+// cached length alone, the rest are checked with the vector kernel.
+// Returns the number of nodes stored in 'out'.
+size_t find_prefix(const List *list, const char *prefix, Node **out,
+                   size_t max)
+{
+    if (list == NULL || prefix == NULL || out == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+
+    size_t len = strlen(prefix);
+    BytesEqualFn equal = __atomic_load_n(&bytes_equal_impl, __ATOMIC_RELAXED);
+    size_t found = 0;
+    Node *i = list->head;
+    while (i != NULL && found < max) {
+        if (i->len >= len && equal(i->data, prefix, len))
+            out[found++] = i;
+        i = i->next;
+    }
+    return found;
+}
+
+// Allocate a new node with 'data' payload
+// Returns pointer to new node if successful.
+// Return NULL if unsuccessful.
+Node *make_node(const char *data)
+{
+    Node *new_node = malloc(sizeof(*new_node));
+    if (new_node == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    size_t bytes = strlen(data) + 1;
+    new_node->data = malloc(sizeof(*new_node->data) * bytes);
+    if (new_node->data == NULL) {
+        print_error(ALLOC_FAIL);
+        free(new_node);
+        return NULL;
+    }
+    new_node->next = NULL;
+    new_node->prev = NULL;
+    new_node->kind = NODE_HEAP;
+    new_node->checkpoint = 0;
+    memcpy(new_node->data, data, bytes);
+    node_set_key(new_node, bytes - 1);
+    return new_node;
+}
+
+// Allocate a new node with 'data' payload stored inline, directly after the
+// node header, so the node and its string share one allocation and usually
+// one cache line.
+// Returns pointer to new node if successful.
+// Return NULL if unsuccessful.
+Node *make_node_inline(const char *data)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    size_t bytes = strlen(data) + 1;
+    Node *new_node = malloc(sizeof(*new_node) + bytes);
+    if (new_node == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    new_node->next = NULL;
+    new_node->prev = NULL;
+    new_node->kind = NODE_INLINE;
+    new_node->checkpoint = 0;
+    new_node->data = (char *)(new_node + 1);
+    memcpy(new_node->data, data, bytes);
+    node_set_key(new_node, bytes - 1);
+    return new_node;
+}
+
+// Allocate a new node with 'data' payload from the calling thread's cache.
+// The node and string share one block, which goes back to the cache of
+// whichever thread releases it. Strings too long for the largest size class
+// get a regular make_node instead.
+// Returns pointer to new node if successful.
+// Return NULL if unsuccessful.
+Node *make_node_cached(const char *data)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    size_t bytes = strlen(data) + 1;
+    int c = node_cache_class(bytes);
+    if (c < 0)
+        return make_node(data);
+    Node *new_node = node_cache_get(c);
+    if (new_node == NULL)
+        return NULL;
+    new_node->next = NULL;
+    new_node->prev = NULL;
+    new_node->kind = NODE_CACHED;
+    new_node->checkpoint = 0;
+    new_node->size_class = (unsigned char)c;
+    new_node->data = (char *)(new_node + 1);
+    memcpy(new_node->data, data, bytes);
+    node_set_key(new_node, bytes - 1);
+    return new_node;
+}
+
+// Number of nodes in 'list', kept up to date by every insert and remove
+size_t list_length(const List *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    return list->size;
+}
+
+// Allocate a skip entry standing for 'node' with 'height' express levels.
+// Returns pointer to new entry if successful.
+// Return NULL if unsuccessful.
+SkipEntry *make_skip_entry(Node *node, int height)
+{
+    SkipEntry *e = malloc(sizeof(*e) + height * sizeof(e->link[0]));
+    if (e == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    e->node = node;
+    e->height = height;
+    int l;
+    for (l = 0; l < height; ++l) {
+        e->link[l].next = NULL;
+        e->link[l].width = 0;
+    }
+    return e;
+}
+
+// Draw an entry height: 0 for most nodes, then one more level with
+// probability 1/SKIP_FANOUT each
+int skip_random_height(SkipIndex *skip)
+{
+    // xorshift64
+    skip->seed ^= skip->seed << 13;
+    skip->seed ^= skip->seed >> 7;
+    skip->seed ^= skip->seed << 17;
+    uint64_t r = skip->seed;
+    int height = 0;
+    while (height < SKIP_MAX_LEVEL && r % SKIP_FANOUT == 0) {
+        ++height;
+        r /= SKIP_FANOUT;
+    }
+    return height;
+}
+
+// Free every entry of 'skip' except the header, and empty the header
+void skip_clear(SkipIndex *skip)
+{
+    SkipEntry *e = skip->header->link[0].next;
+    while (e != NULL) {
+        SkipEntry *tmp = e->link[0].next;
+        free(e);
+        e = tmp;
+    }
+    int l;
+    for (l = 0; l < SKIP_MAX_LEVEL; ++l) {
+        skip->header->link[l].next = NULL;
+        skip->header->link[l].width = 0;
+    }
+    skip->level = 0;
+}
+
+// Rebuild the skip index of 'list' from scratch in one walk.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int skip_rebuild(List *list)
+{
+    SkipIndex *skip = list->skip;
+    skip_clear(skip);
+
+    SkipEntry *tail[SKIP_MAX_LEVEL];
+    size_t tail_rank[SKIP_MAX_LEVEL];
+    int l;
+    for (l = 0; l < SKIP_MAX_LEVEL; ++l) {
+        tail[l] = skip->header;
+        tail_rank[l] = 0;
+    }
+    size_t rank = 1;
+    Node *i;
+    for (i = list->head; i != NULL; i = i->next, ++rank) {
+        int height = skip_random_height(skip);
+        if (height == 0)
+            continue;
+        SkipEntry *e = make_skip_entry(i, height);
+        if (e == NULL) {
+            skip_clear(skip);
+            return ALLOC_FAIL;
+        }
+        for (l = 0; l < height; ++l) {
+            tail[l]->link[l].next = e;
+            tail[l]->link[l].width = rank - tail_rank[l];
+            tail[l] = e;
+            tail_rank[l] = rank;
+        }
+        if (height > skip->level)
+            skip->level = height;
+    }
+    skip->stale = 0;
+    skip->walked = 0;
+    return 0;
+}
+
+// Descend the skip index of 'list' to the last entry ranked below 'rank'
+// (the node at position k has rank k + 1; the header has rank 0). Fills
+// 'update' and 'update_rank' per level when they are not NULL.
+// Returns the node with rank 'rank'.
+Node *skip_seek(const List *list, size_t rank, SkipEntry **update,
+                size_t *update_rank)
+{
+    const SkipIndex *skip = list->skip;
+    SkipEntry *e = skip->header;
+    size_t e_rank = 0;
+    int l;
+    for (l = SKIP_MAX_LEVEL - 1; l >= skip->level && update != NULL; --l) {
+        update[l] = e;
+        update_rank[l] = 0;
+    }
+    for (l = skip->level - 1; l >= 0; --l) {
+        while (e->link[l].next != NULL && e_rank + e->link[l].width < rank) {
+            e_rank += e->link[l].width;
+            e = e->link[l].next;
+        }
+        if (update != NULL) {
+            update[l] = e;
+            update_rank[l] = e_rank;
+        }
+    }
+    // At most a few hops on the base chain remain
+    Node *n = e == skip->header ? list->head : e->node;
+    size_t n_rank = e == skip->header ? 1 : e_rank;
+    while (n != NULL && n_rank < rank) {
+        n = n->next;
+        ++n_rank;
+    }
+    return n;
+}
+
+// Attach a skip index to 'list' so that list_at, insert_at and remove_at run
+// in O(log n). insert_at and remove_at keep it up to date; any other insert
+// or remove marks it stale. While it is stale positional accesses walk the
+// list, and once they have walked as many nodes as the list holds it is
+// rebuilt in one more walk, so a burst of other mutations costs at most
+// twice the plain walks.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_skip_attach(List *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (list->skip != NULL)
+        return 0;
+
+    SkipIndex *skip = malloc(sizeof(*skip));
+    if (skip == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    skip->header = make_skip_entry(NULL, SKIP_MAX_LEVEL);
+    if (skip->header == NULL) {
+        free(skip);
+        return ALLOC_FAIL;
+    }
+    skip->level = 0;
+    skip->stale = 1;
+    skip->walked = 0;
+    skip->seed = 0x9E3779B97F4A7C15ull;
+    list->skip = skip;
+    return 0;
+}
+
+// Drop the skip index of 'list', if it has one
+void list_skip_detach(List *list)
+{
+    if (list == NULL || list->skip == NULL)
+        return;
+    skip_clear(list->skip);
+    free(list->skip->header);
+    free(list->skip);
+    list->skip = NULL;
+}
+
+// Make sure the skip index of 'list', if any, is usable. A stale index is
+// only rebuilt once the walks made in its place add up to the list length.
+// Returns 1 if the index can be used, 0 if the caller must walk instead.
+int skip_ready(List *list)
+{
+    SkipIndex *skip = list->skip;
+    if (skip == NULL)
+        return 0;
+    if (!skip->stale)
+        return 1;
+    if (skip->walked < list->size)
+        return 0;
+    return skip_rebuild(list) == 0;
+}
+
+// Get the node at position 'index' (0 is the head). Uses the skip index if
+// one is attached, otherwise walks from whichever end is closer.
+// Returns pointer to node if found.
+// Return NULL if 'index' is out of range or if 'list' is NULL.
+Node *list_at(List *list, size_t index)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    if (index >= list->size) {
+        print_error(INDEX_INVALID);
+        return NULL;
+    }
+
+    if (skip_ready(list))
+        return skip_seek(list, index + 1, NULL, NULL);
+
+    Node *i;
+    size_t pos;
+    size_t steps;
+    if (index < list->size / 2) {
+        for (i = list->head, pos = 0; pos < index; ++pos)
+            i = i->next;
+        steps = index;
+    } else {
+        for (i = list->last, pos = list->size - 1; pos > index; --pos)
+            i = i->prev;
+        steps = list->size - 1 - index;
+    }
+    if (list->skip != NULL)
+        list->skip->walked += steps + 1;
+    return i;
+}
+
+// Inserts 'new_node' into 'list' so that it ends up at position 'index'
+// (equal to the length to append).
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int insert_at(List *list, size_t index, Node *new_node)
+{
+    if (list == NULL || new_node == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (index > list->size) {
+        print_error(INDEX_INVALID);
+        return INDEX_INVALID;
+    }
+
+    if (!skip_ready(list)) {
+        if (index == list->size)
+            return insert_end(list, new_node);
+        return insert_before(list, list_at(list, index), new_node);
+    }
+
+    SkipIndex *skip = list->skip;
+    SkipEntry *update[SKIP_MAX_LEVEL];
+    size_t update_rank[SKIP_MAX_LEVEL];
+    size_t rank = index + 1;
+    Node *at = skip_seek(list, rank, update, update_rank);
+    int ret = at == NULL ? insert_end(list, new_node)
+                         : insert_before(list, at, new_node);
+    if (ret != 0)
+        return ret;
+
+    // Linking marked the index stale; patch it up instead
+    int height = skip_random_height(skip);
+    SkipEntry *e = NULL;
+    if (height > 0) {
+        e = make_skip_entry(new_node, height);
+        if (e == NULL)
+            return 0; // still stale, so the next access rebuilds
+    }
+    int l;
+    for (l = 0; l < SKIP_MAX_LEVEL; ++l) {
+        SkipEntry *u = update[l];
+        if (l < height) {
+            e->link[l].next = u->link[l].next;
+            if (e->link[l].next != NULL)
+                e->link[l].width = update_rank[l] + u->link[l].width + 1
+                                   - rank;
+            u->link[l].next = e;
+            u->link[l].width = rank - update_rank[l];
+        } else if (u->link[l].next != NULL) {
+            ++u->link[l].width;
+        }
+    }
+    if (height > skip->level)
+        skip->level = height;
+    skip->stale = 0;
+    return 0;
+}
+
+// Removes the node at position 'index' (0 is the head). With a skip index
+// that is up to date this is O(log n) and the index stays up to date.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int remove_at(List *list, size_t index)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (index >= list->size) {
+        print_error(INDEX_INVALID);
+        return INDEX_INVALID;
+    }
+
+    if (!skip_ready(list))
+        return remove_node(list, list_at(list, index));
+
+    SkipIndex *skip = list->skip;
+    SkipEntry *update[SKIP_MAX_LEVEL];
+    size_t update_rank[SKIP_MAX_LEVEL];
+    Node *at = skip_seek(list, index + 1, update, update_rank);
+    SkipEntry *e = update[0]->link[0].next;
+    if (e != NULL && e->node != at)
+        e = NULL;
+    int l;
+    for (l = 0; l < SKIP_MAX_LEVEL; ++l) {
+        SkipEntry *u = update[l];
+        if (e != NULL && l < e->height) {
+            u->link[l].next = e->link[l].next;
+            u->link[l].width += e->link[l].width - 1;
+        } else if (u->link[l].next != NULL) {
+            --u->link[l].width;
+        }
+    }
+    free(e);
+
+    // Unlinking marks the index stale; it was patched up above
+    int ret = remove_node(list, at);
+    skip->stale = 0;
+    return ret;
+}
+
+// Attach a hash index to 'list' so that find runs in O(1) on average. The
+// index is kept up to date by the insert functions and remove_node.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_index_attach(List *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (list->index != NULL)
+        return 0;
+
+    HashIndex *index = malloc(sizeof(*index));
+    if (index == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->used = 0;
+    if (hash_index_resize(index, HASH_INDEX_MIN_CAPACITY) != 0) {
+        free(index);
+        return ALLOC_FAIL;
+    }
+
+    Node *i = list->head;
+    while (i != NULL) {
+        if (hash_index_add(index, i) != 0) {
+            free(index->slots);
+            free(index);
+            return ALLOC_FAIL;
+        }
+        i = i->next;
+    }
+    list->index = index;
+    return 0;
+}
+
+// Drop the hash index of 'list', if it has one
+void list_index_detach(List *list)
+{
+    if (list == NULL || list->index == NULL)
+        return;
+    free(list->index->slots);
+    free(list->index);
+    list->index = NULL;
+}
+
+// Attach checkpoints every 'stride' nodes to 'list' so that find_parallel
+// can split it into segments. They are rebuilt in one walk when stale or
+// when the list has grown enough to unbalance the segments.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_checkpoints_attach(List *list, size_t stride)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (stride == 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    if (list->checkpoints != NULL) {
+        list->checkpoints->stride = stride;
+        list->checkpoints->stale = 1;
+        return 0;
+    }
+    Checkpoints *cp = malloc(sizeof(*cp));
+    if (cp == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    cp->nodes = NULL;
+    cp->count = 0;
+    cp->capacity = 0;
+    cp->stride = stride;
+    cp->built_size = 0;
+    cp->stale = 1;
+    list->checkpoints = cp;
+    return 0;
+}
+
+// Drop the checkpoints of 'list', if it has any
+void list_checkpoints_detach(List *list)
+{
+    if (list == NULL || list->checkpoints == NULL)
+        return;
+    free(list->checkpoints->nodes);
+    free(list->checkpoints);
+    list->checkpoints = NULL;
+}
+
+// Record every stride-th node of 'list' again, flagging exactly those nodes.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int checkpoints_rebuild(List *list)
+{
+    Checkpoints *cp = list->checkpoints;
+    size_t need = list->size / cp->stride;
+    if (need > cp->capacity) {
+        Node **nodes = realloc(cp->nodes, need * sizeof(*nodes));
+        if (nodes == NULL) {
+            print_error(ALLOC_FAIL);
+            return ALLOC_FAIL;
+        }
+        cp->nodes = nodes;
+        cp->capacity = need;
+    }
+    cp->count = 0;
+    size_t pos = 0;
+    Node *i;
+    for (i = list->head; i != NULL; i = i->next, ++pos) {
+        i->checkpoint = pos > 0 && pos % cp->stride == 0;
+        if (i->checkpoint)
+            cp->nodes[cp->count++] = i;
+    }
+    cp->built_size = list->size;
+    cp->stale = 0;
+    return 0;
+}
+
+// Make sure the checkpoints of 'list', if any, are usable.
+// Returns 1 if they can be used, 0 if the caller must walk instead.
+int checkpoints_ready(List *list)
+{
+    Checkpoints *cp = list->checkpoints;
+    if (cp == NULL)
+        return 0;
+    if (!cp->stale && list->size <= 2 * cp->built_size + cp->stride)
+        return 1;
+    return checkpoints_rebuild(list) == 0;
+}
+
+// Deallocate all dynamic memory associated with 'list'
+void dealloc_list(List *list)
+{
+    if (list == NULL) {
+        return;
+    }
+    list_index_detach(list);
+    list_skip_detach(list);
+    list_checkpoints_detach(list);
+    Node *i = list->head;
+    while (i != NULL) {
+        Node *tmp = i->next;
+        release_node(list, i);
+        i = tmp;
+    }
+    ArenaBlock *b = list->arena;
+    while (b != NULL) {
+        ArenaBlock *tmp = b->next;
+        free(b);
+        b = tmp;
+    }
+}
+
+// Make 'list' an empty list with no pool, indexes or arena
+void init_empty_list(List *list)
+{
+    list->head = NULL;
+    list->last = NULL;
+    list->size = 0;
+    list->pool = NULL;
+    list->index = NULL;
+    list->skip = NULL;
+    list->arena = NULL;
+    list->checkpoints = NULL;
+    list->organize = ORGANIZE_NONE;
+}
+
+// Like init_list, but every node is drawn from 'pool' and is recycled into it
+// by remove_node and dealloc_list. A NULL 'pool' gives plain make_node nodes.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_list_pooled(List *list, NodePool *pool, const char *data[],
+                     int data_len)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (data_len < 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+
+    init_empty_list(list);
+    list->pool = pool;
+
+    // Allocate each node
+    int i;
+    for (i = 0; i < data_len; ++i) {
+        Node *new_node = pool ? node_pool_make_node(pool, data[i])
+                              : make_node(data[i]);
+        if (new_node == NULL) {
+            dealloc_list(list);
+            return ALLOC_FAIL;
+        }
+        insert_end(list, new_node);
+    }
+
+    return 0;
+}
+
+// Attempts to dynamically allocate 'data_len' Node objects for 'list'.
+// You must provide a static array of string data that will be copied into the
+// newly allocated data structure.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_list(List *list, const char *data[], int data_len)
+{
+    return init_list_pooled(list, NULL, data, data_len);
+}
+
+// Allocate one block holding 'data_len' (at least 1) NODE_ARENA nodes for
+// 'data', already linked to each other in order, followed by their strings.
+// Returns pointer to the block if successful.
+// Return NULL if unsuccessful.
+ArenaBlock *arena_block_make(const char *data[], int data_len)
+{
+    size_t bytes = sizeof(ArenaBlock) + sizeof(Node) * data_len;
+    int i;
+    for (i = 0; i < data_len; ++i)
+        bytes += strlen(data[i]) + 1;
+    ArenaBlock *block = malloc(bytes);
+    if (block == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    block->next = NULL;
+
+    char *strings = (char *)(block->nodes + data_len);
+    for (i = 0; i < data_len; ++i) {
+        Node *n = &block->nodes[i];
+        n->prev = i > 0 ? n - 1 : NULL;
+        n->next = i < data_len - 1 ? n + 1 : NULL;
+        n->kind = NODE_ARENA;
+        n->checkpoint = 0;
+        n->hits = 0;
+        n->data = strings;
+        strings = stpcpy(strings, data[i]);
+        node_set_key(n, strings - n->data);
+        ++strings;
+    }
+    return block;
+}
+
+// Like init_list, but all 'data_len' nodes and their strings are placed in a
+// single allocation, so building the list costs one malloc and tearing it
+// down one free. remove_node on such a list only unlinks arena nodes; their
+// memory is reclaimed by dealloc_list. Other kinds of nodes may still be
+// inserted and behave as usual.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_list_arena(List *list, const char *data[], int data_len)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (data_len < 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+
+    init_empty_list(list);
+    if (data_len == 0)
+        return 0;
+
+    ArenaBlock *block = arena_block_make(data, data_len);
+    if (block == NULL)
+        return ALLOC_FAIL;
+    list->head = &block->nodes[0];
+    list->last = &block->nodes[data_len - 1];
+    list->size = data_len;
+    list->arena = block;
+    return 0;
+}
+
+// Allocate one block holding 'data_len' (at least 1) NODE_BATCH nodes for
+// 'data', already linked to each other in order, followed by their strings.
+// Returns pointer to the block if successful.
+// Return NULL if unsuccessful.
+BatchBlock *batch_block_make(const char *data[], int data_len)
+{
+    size_t bytes = sizeof(BatchBlock) + sizeof(Node) * data_len;
+    int i;
+    for (i = 0; i < data_len; ++i)
+        bytes += batch_slot_bytes(strlen(data[i]));
+    BatchBlock *block = malloc(bytes);
+    if (block == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    block->live = data_len;
+
+    char *slot = (char *)(block->nodes + data_len);
+    for (i = 0; i < data_len; ++i) {
+        Node *n = &block->nodes[i];
+        n->prev = i > 0 ? n - 1 : NULL;
+        n->next = i < data_len - 1 ? n + 1 : NULL;
+        n->kind = NODE_BATCH;
+        n->checkpoint = 0;
+        n->hits = 0;
+        *(BatchBlock **)slot = block;
+        n->data = slot + sizeof(BatchBlock *);
+        size_t len = stpcpy(n->data, data[i]) - n->data;
+        node_set_key(n, len);
+        slot += batch_slot_bytes(len);
+    }
+    return block;
+}
+
+// Insert copies of the 'data_len' strings of 'data', in order, between
+// 'before' and 'after' (either may be NULL at the ends of the list). All
+// nodes and strings share one BatchBlock, which is prelinked and then
+// spliced in with a single update at each end. The nodes are otherwise
+// ordinary: remove_node frees the block once its last node goes, and they
+// may be spliced into other lists.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int insert_batch_between(List *list, Node *before, Node *after,
+                         const char *data[], int data_len)
+{
+    if (data_len < 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    if (data_len == 0)
+        return 0;
+    BatchBlock *block = batch_block_make(data, data_len);
+    if (block == NULL)
+        return ALLOC_FAIL;
+    Node *first = &block->nodes[0];
+    Node *last = &block->nodes[data_len - 1];
+    int i;
+    for (i = 0; i < data_len; ++i) {
+        int ret = list_track_link(list, &block->nodes[i]);
+        if (ret != 0) {
+            while (--i >= 0)
+                list_track_unlink(list, &block->nodes[i]);
+            free(block);
+            return ret;
+        }
+    }
+
+    first->prev = before;
+    last->next = after;
+    if (after == NULL)
+        list->last = last;
+    else
+        after->prev = last;
+    if (before == NULL)
+        LINK_PUBLISH(list->head, first);
+    else
+        LINK_PUBLISH(before->next, first);
+    return 0;
+}
+
+// Inserts copies of the 'data_len' strings of 'data' into 'list' after
+// 'node', in order, as one batch block (see insert_batch_between).
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int insert_batch_after(List *list, Node *node, const char *data[],
+                       int data_len)
+{
+    if (list == NULL || node == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    return insert_batch_between(list, node, node->next, data, data_len);
+}
+
+// Inserts copies of the 'data_len' strings of 'data' at the end of 'list',
+// in order, as one batch block (see insert_batch_between).
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int insert_batch_end(List *list, const char *data[], int data_len)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    return insert_batch_between(list, list->last, NULL, data, data_len);
+}
+
+// Cut the nodes from 'first' through 'last' out of 'src' and link them into
+// 'dst' before 'pos' (at the end when 'pos' is NULL). Only the links at the
+// four ends change; no bookkeeping is done.
+void list_relink_range(List *dst, Node *pos, List *src, Node *first,
+                       Node *last)
+{
+    Node *before = first->prev;
+    Node *after = last->next;
+    if (before == NULL)
+        LINK_PUBLISH(src->head, after);
+    else
+        LINK_PUBLISH(before->next, after);
+    if (after == NULL)
+        src->last = before;
+    else
+        after->prev = before;
+
+    before = pos == NULL ? dst->last : pos->prev;
+    first->prev = before;
+    last->next = pos;
+    if (pos == NULL)
+        dst->last = last;
+    else
+        pos->prev = last;
+    if (before == NULL)
+        LINK_PUBLISH(dst->head, first);
+    else
+        LINK_PUBLISH(before->next, first);
+}
+
+// Move the nodes from 'first' through 'last' (in 'src' order) into 'dst'
+// before 'pos', or at the end of 'dst' when 'pos' is NULL. 'whole' says the
+// range is all of 'src', whose arena blocks then go along with it.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful; nothing has moved then.
+int list_move_range(List *dst, Node *pos, List *src, Node *first, Node *last,
+                    int whole)
+{
+    // One walk counts the range and checks that every node may move
+    size_t count = 0;
+    int hit_checkpoint = 0;
+    Node *n = first;
+    for (;;) {
+        if (n == NULL || (src == dst && n == pos)) {
+            print_error(INDEX_INVALID);
+            return INDEX_INVALID;
+        }
+        if (src != dst && ((n->kind == NODE_POOL && src->pool != dst->pool)
+                           || (n->kind == NODE_ARENA && !whole))) {
+            print_error(OWNER_MISMATCH);
+            return OWNER_MISMATCH;
+        }
+        hit_checkpoint |= n->checkpoint;
+        ++count;
+        if (n == last)
+            break;
+        n = n->next;
+    }
+
+    if (src != dst) {
+        // Linking into 'dst' is the step that can fail, so it goes first
+        for (n = first; n != last->next; n = n->next) {
+            int ret = list_track_link(dst, n);
+            if (ret != 0) {
+                Node *undo;
+                for (undo = first; undo != n; undo = undo->next)
+                    list_track_unlink(dst, undo);
+                return ret;
+            }
+        }
+        for (n = first; n != last->next; n = n->next)
+            list_track_unlink(src, n);
+        if (hit_checkpoint && src->checkpoints != NULL)
+            src->checkpoints->stale = 1;
+        if (whole && src->arena != NULL) {
+            ArenaBlock *b = src->arena;
+            while (b->next != NULL)
+                b = b->next;
+            b->next = dst->arena;
+            dst->arena = src->arena;
+            src->arena = NULL;
+        }
+    } else {
+        list_track_reorder(dst);
+    }
+    list_relink_range(dst, pos, src, first, last);
+    return 0;
+}
+
+// Move the nodes from 'first' through 'last' out of 'src' and into 'dst'
+// before 'pos' (at the end when 'pos' is NULL). Only links are rewritten:
+// nothing is allocated or copied, apart from index slots in 'dst'. 'src'
+// and 'dst' may be the same list, with 'pos' outside the range. Pool nodes
+// can only move between lists sharing the same pool, and arena nodes only
+// with list_concat. The cost is O(k) in the length of the range, even
+// without indexes: every node is checked, and counted so that the size of
+// both lists and their hash indexes stay exact. list_splice_n avoids the
+// walk when the caller knows the length.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_splice(List *dst, Node *pos, List *src, Node *first, Node *last)
+{
+    if (dst == NULL || src == NULL || first == NULL || last == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    return list_move_range(dst, pos, src, first, last, 0);
+}
+
+// Like list_splice, for a caller that knows the range holds 'count' nodes.
+// When the lists differ, neither has a hash index, they share a pool and
+// 'src' has no arena blocks, this is O(1): only the ends of the range are
+// relinked and 'count' is taken on trust for the sizes, so it must be
+// exact. Otherwise it is list_splice, and 'count' is ignored.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_splice_n(List *dst, Node *pos, List *src, Node *first, Node *last,
+                  size_t count)
+{
+    if (dst == NULL || src == NULL || first == NULL || last == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (src == dst || dst->index != NULL || src->index != NULL
+        || src->pool != dst->pool || src->arena != NULL)
+        return list_move_range(dst, pos, src, first, last, 0);
+    list_relink_range(dst, pos, src, first, last);
+    src->size -= count;
+    dst->size += count;
+    list_track_reorder(src);
+    list_track_reorder(dst);
+    return 0;
+}
+
+// Move every node of 'src' to the end of 'dst', leaving 'src' empty. This
+// is O(1) when neither list has a hash index and the nodes don't need a
+// different pool; otherwise it costs one walk of 'src'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_concat(List *dst, List *src)
+{
+    if (dst == NULL || src == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (src->head == NULL || src == dst)
+        return 0;
+    if (dst->index != NULL || src->index != NULL
+        || (src->pool != NULL && src->pool != dst->pool))
+        return list_move_range(dst, NULL, src, src->head, src->last, 1);
+
+    if (dst->last == NULL)
+        LINK_PUBLISH(dst->head, src->head);
+    else
+        LINK_PUBLISH(dst->last->next, src->head);
+    src->head->prev = dst->last;
+    dst->last = src->last;
+    dst->size += src->size;
+    if (src->arena != NULL) {
+        ArenaBlock *b = src->arena;
+        while (b->next != NULL)
+            b = b->next;
+        b->next = dst->arena;
+        dst->arena = src->arena;
+    }
+    // Appending only lengthens the last checkpoint segment of 'dst'
+    if (dst->skip != NULL)
+        dst->skip->stale = 1;
+    list_track_reorder(src);
+    LINK_PUBLISH(src->head, NULL);
+    src->last = NULL;
+    src->size = 0;
+    src->arena = NULL;
+    return 0;
+}
+
+// Split 'list' before 'node': 'node' and everything after it move to
+// 'rest', which is initialized as a new list drawing on the same pool. Arena
+// lists can only be split at the head. Like list_splice this is O(k) in the
+// number of nodes moved, to keep both sizes and any hash index exact.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_split_at(List *list, Node *node, List *rest)
+{
+    if (list == NULL || node == NULL || rest == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    init_empty_list(rest);
+    rest->pool = list->pool;
+    return list_move_range(rest, NULL, list, node, list->last,
+                           node == list->head);
+}
+
+// Decides which nodes list_remove_if takes out; nonzero means remove
+typedef int (*NodePredicate)(const Node *node, void *ctx);
+
+// Unlink every node of 'list' for which 'pred' holds in one walk, chaining
+// the removed nodes through 'next' into '*graveyard', in list order.
+// Returns the number of nodes unlinked.
+size_t list_unlink_if(List *list, NodePredicate pred, void *ctx,
+                      Node **graveyard)
+{
+    Node *head = NULL;
+    Node **tail = &head;
+    size_t count = 0;
+    Node *n = list->head;
+    while (n != NULL) {
+        Node *next = n->next;
+        if (pred(n, ctx)) {
+            unlink_node(list, n);
+            *tail = n;
+            tail = &n->next;
+            ++count;
+        }
+        n = next;
+    }
+    *tail = NULL;
+    *graveyard = head;
+    return count;
+}
+
+// Release a chain of unlinked nodes of 'list' linked through 'next'
+void release_chain(List *list, Node *chain)
+{
+    while (chain != NULL) {
+        Node *tmp = chain->next;
+        release_node(list, chain);
+        chain = tmp;
+    }
+}
+
+// Remove every node of 'list' for which 'pred' holds, in a single pass. The
+// nodes are unlinked first and all freed together afterwards.
+// Returns the number of nodes removed, or 0 if 'list' or 'pred' is NULL.
+size_t list_remove_if(List *list, NodePredicate pred, void *ctx)
+{
+    if (list == NULL || pred == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    Node *graveyard;
+    size_t count = list_unlink_if(list, pred, ctx, &graveyard);
+    release_chain(list, graveyard);
+    return count;
+}
+
+// Background thread that frees chains of unlinked nodes, so that callers of
+// list_remove_if_deferred don't pay for the free calls
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signalled when chains arrive or on shutdown
+    pthread_cond_t idle; // signalled when the pending chains are freed
+    Node *pending;       // chained through 'next'
+    int busy;
+    int stop;
+} Reaper;
+
+void *reaper_main(void *arg)
+{
+    Reaper *reaper = arg;
+    pthread_mutex_lock(&reaper->lock);
+    for (;;) {
+        while (reaper->pending == NULL && !reaper->stop)
+            pthread_cond_wait(&reaper->work, &reaper->lock);
+        if (reaper->pending == NULL)
+            break;
+        Node *chain = reaper->pending;
+        reaper->pending = NULL;
+        reaper->busy = 1;
+        pthread_mutex_unlock(&reaper->lock);
+        // Never pool nodes, so no list is needed to release them
+        release_chain(NULL, chain);
+        pthread_mutex_lock(&reaper->lock);
+        reaper->busy = 0;
+        if (reaper->pending == NULL)
+            pthread_cond_broadcast(&reaper->idle);
+    }
+    pthread_mutex_unlock(&reaper->lock);
+    // Hand the NODE_CACHED blocks freed above back to the depot now rather
+    // than relying on the thread exit hook
+    node_cache_flush();
+    return NULL;
+}
+
+// Start the freeing thread.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_reaper(Reaper *reaper)
+{
+    if (reaper == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    pthread_mutex_init(&reaper->lock, NULL);
+    pthread_cond_init(&reaper->work, NULL);
+    pthread_cond_init(&reaper->idle, NULL);
+    reaper->pending = NULL;
+    reaper->busy = 0;
+    reaper->stop = 0;
+    if (pthread_create(&reaper->thread, NULL, reaper_main, reaper) != 0) {
+        print_error(ALLOC_FAIL);
+        pthread_mutex_destroy(&reaper->lock);
+        pthread_cond_destroy(&reaper->work);
+        pthread_cond_destroy(&reaper->idle);
+        return ALLOC_FAIL;
+    }
+    return 0;
+}
+
+// Like list_remove_if, but the removed nodes are freed by 'reaper' in the
+// background. Pool and arena nodes are still released by the caller, since
+// NodePools aren't thread-safe and arena nodes cost nothing to release.
+// Returns the number of nodes removed, or 0 if any argument but 'ctx' is
+// NULL.
+size_t list_remove_if_deferred(List *list, NodePredicate pred, void *ctx,
+                               Reaper *reaper)
+{
+    if (list == NULL || pred == NULL || reaper == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    Node *graveyard;
+    size_t count = list_unlink_if(list, pred, ctx, &graveyard);
+    Node *head = NULL;
+    Node *last = NULL;
+    while (graveyard != NULL) {
+        Node *n = graveyard;
+        graveyard = n->next;
+        if (n->kind == NODE_POOL || n->kind == NODE_ARENA) {
+            release_node(list, n);
+            continue;
+        }
+        n->next = head;
+        head = n;
+        if (last == NULL)
+            last = n;
+    }
+    if (head != NULL) {
+        pthread_mutex_lock(&reaper->lock);
+        last->next = reaper->pending;
+        reaper->pending = head;
+        pthread_cond_signal(&reaper->work);
+        pthread_mutex_unlock(&reaper->lock);
+    }
+    return count;
+}
+
+// Block until every node handed to 'reaper' so far has been freed
+void reaper_wait(Reaper *reaper)
+{
+    pthread_mutex_lock(&reaper->lock);
+    while (reaper->pending != NULL || reaper->busy)
+        pthread_cond_wait(&reaper->idle, &reaper->lock);
+    pthread_mutex_unlock(&reaper->lock);
+}
+
+// Free whatever is still pending and stop the freeing thread
+void dealloc_reaper(Reaper *reaper)
+{
+    if (reaper == NULL)
+        return;
+    pthread_mutex_lock(&reaper->lock);
+    reaper->stop = 1;
+    pthread_cond_signal(&reaper->work);
+    pthread_mutex_unlock(&reaper->lock);
+    pthread_join(reaper->thread, NULL);
+    pthread_mutex_destroy(&reaper->lock);
+    pthread_cond_destroy(&reaper->work);
+    pthread_cond_destroy(&reaper->idle);
+}
+
+// Fixed set of worker threads draining a shared FIFO of caller-owned tasks.
+// Tasks are never allocated by the pool, so submitting is just a push.
+typedef struct Task Task;
+struct Task {
+    void (*run)(void *arg);
+    void *arg;
+    Task *next;
+};
+
+typedef struct {
+    pthread_t *threads;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signalled when tasks arrive or on shutdown
+    pthread_cond_t idle; // signalled when the last pending task finishes
+    Task *head;
+    Task *tail;
+    int pending;         // submitted but not yet finished
+    int stop;
+} WorkerPool;
+
+void *worker_main(void *arg)
+{
+    WorkerPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->stop)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->head == NULL)
+            break;
+        Task *t = pool->head;
+        pool->head = t->next;
+        if (pool->head == NULL)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        t->run(t->arg);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start 'threads' workers.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int worker_pool_init(WorkerPool *pool, int threads)
+{
+    if (pool == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (threads <= 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    pool->threads = malloc(threads * sizeof(*pool->threads));
+    if (pool->threads == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->pending = 0;
+    pool->stop = 0;
+    for (pool->count = 0; pool->count < threads; ++pool->count) {
+        if (pthread_create(&pool->threads[pool->count], NULL, worker_main,
+                           pool) != 0)
+            break;
+    }
+    if (pool->count == 0) {
+        print_error(ALLOC_FAIL);
+        free(pool->threads);
+        return ALLOC_FAIL;
+    }
+    return 0;
+}
+
+// Queue 'task'; it must stay alive until worker_pool_wait returns
+void worker_pool_submit(WorkerPool *pool, Task *task)
+{
+    task->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail != NULL)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    ++pool->pending;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Block until every submitted task has finished
+void worker_pool_wait(WorkerPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending != 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Finish queued tasks, stop the workers and free the pool's memory
+void worker_pool_dealloc(WorkerPool *pool)
+{
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    int i;
+    for (i = 0; i < pool->count; ++i)
+        pthread_join(pool->threads[i], NULL);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+}
+
+// Orders two nodes like strcmp orders strings. 'ctx' is passed through from
+// the sort call.
+typedef int (*NodeCompare)(const Node *a, const Node *b, void *ctx);
+
+int node_compare_data(const Node *a, const Node *b, void *ctx)
+{
+    (void)ctx;
+    return strcmp(a->data, b->data);
+}
+
+// Stable merge of two NULL-terminated chains linked through 'next'; on ties
+// nodes from 'a' come first
+Node *merge_chains(Node *a, Node *b, NodeCompare cmp, void *ctx)
+{
+    Node *head = NULL;
+    Node **tail = &head;
+    while (a != NULL && b != NULL) {
+        if (cmp(a, b, ctx) <= 0) {
+            *tail = a;
+            a = a->next;
+        } else {
+            *tail = b;
+            b = b->next;
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = a != NULL ? a : b;
+    return head;
+}
+
+#define SORT_BINS 64
+
+// Natural merge sort of a NULL-terminated chain linked through 'next'. The
+// chain is consumed one non-decreasing run at a time; runs are merged like
+// a binary counter, where bins[k] holds a sorted chain built from 2^k runs,
+// so presorted input costs a single pass. 'prev' pointers are left stale.
+Node *sort_chain(Node *head, NodeCompare cmp, void *ctx)
+{
+    Node *bins[SORT_BINS] = { NULL };
+    Node *p = head;
+    while (p != NULL) {
+        Node *run = p;
+        while (p->next != NULL && cmp(p, p->next, ctx) <= 0)
+            p = p->next;
+        Node *rest = p->next;
+        p->next = NULL;
+        p = rest;
+
+        // Bins always hold older nodes than 'run', so they go first
+        int k;
+        for (k = 0; k < SORT_BINS - 1 && bins[k] != NULL; ++k) {
+            run = merge_chains(bins[k], run, cmp, ctx);
+            bins[k] = NULL;
+        }
+        if (bins[k] != NULL)
+            run = merge_chains(bins[k], run, cmp, ctx);
+        bins[k] = run;
+    }
+
+    Node *result = NULL;
+    int k;
+    for (k = 0; k < SORT_BINS; ++k) {
+        if (bins[k] != NULL)
+            result = merge_chains(bins[k], result, cmp, ctx);
+    }
+    return result;
+}
+
+// Relink 'list' around the sorted chain starting at 'head', restoring 'prev'
+// pointers and 'last'
+void adopt_sorted_chain(List *list, Node *head)
+{
+    list->head = head;
+    Node *prev = NULL;
+    Node *i;
+    for (i = head; i != NULL; i = i->next) {
+        i->prev = prev;
+        prev = i;
+    }
+    list->last = prev;
+    list_track_reorder(list);
+}
+
+// Sort 'list' in place, stably, by relinking its nodes; nothing is
+// allocated. 'cmp' may be NULL to sort by contents.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sort_list(List *list, NodeCompare cmp, void *ctx)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (cmp == NULL)
+        cmp = node_compare_data;
+    adopt_sorted_chain(list, sort_chain(list->head, cmp, ctx));
+    return 0;
+}
+
+// One slice of a parallel sort: sorts or merges chains in place
+typedef struct {
+    Task task;
+    Node *head;
+    Node *other; // chain to merge into 'head', NULL while sorting
+    NodeCompare cmp;
+    void *ctx;
+} SortJob;
+
+void sort_job_run(void *arg)
+{
+    SortJob *job = arg;
+    if (job->other == NULL) {
+        job->head = sort_chain(job->head, job->cmp, job->ctx);
+    } else {
+        job->head = merge_chains(job->head, job->other, job->cmp, job->ctx);
+    }
+}
+
+// Like sort_list, but cuts the list into one slice per worker of 'pool',
+// sorts the slices concurrently and then merges them pairwise, also on the
+// pool. The result is identical to sort_list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sort_list_parallel(List *list, NodeCompare cmp, void *ctx,
+                       WorkerPool *pool)
+{
+    if (list == NULL || pool == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (cmp == NULL)
+        cmp = node_compare_data;
+    size_t slices = pool->count;
+    if (slices > list->size / 2)
+        slices = list->size / 2;
+    if (slices <= 1)
+        return sort_list(list, cmp, ctx);
+
+    SortJob *jobs = malloc(slices * sizeof(*jobs));
+    if (jobs == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    Node *n = list->head;
+    size_t i;
+    for (i = 0; i < slices; ++i) {
+        size_t len = list->size / slices + (i < list->size % slices);
+        jobs[i].head = n;
+        jobs[i].other = NULL;
+        jobs[i].cmp = cmp;
+        jobs[i].ctx = ctx;
+        jobs[i].task.run = sort_job_run;
+        jobs[i].task.arg = &jobs[i];
+        while (--len > 0)
+            n = n->next;
+        Node *rest = n->next;
+        n->next = NULL;
+        n = rest;
+        worker_pool_submit(pool, &jobs[i].task);
+    }
+    worker_pool_wait(pool);
+
+    // Merge neighbours so that equal elements keep their relative order
+    size_t step;
+    for (step = 1; step < slices; step *= 2) {
+        for (i = 0; i + step < slices; i += 2 * step) {
+            jobs[i].other = jobs[i + step].head;
+            worker_pool_submit(pool, &jobs[i].task);
+        }
+        worker_pool_wait(pool);
+    }
+    adopt_sorted_chain(list, jobs[0].head);
+    free(jobs);
+    return 0;
+}
+
+// Shared state of one find_parallel call. Workers claim segments in list
+// order; 'best' is the lowest segment known to hold a match, so any segment
+// after it can be abandoned.
+typedef struct {
+    List *list;
+    const char *data;
+    size_t len;
+    uint32_t hash;
+    size_t segments;
+    size_t next_segment;
+    size_t best;
+    Node *found;
+    pthread_mutex_t lock; // guards updates of 'best' and 'found'
+} ParallelFind;
+
+typedef struct {
+    Task task;
+    ParallelFind *find;
+} FindJob;
+
+// Nodes scanned between checks for a match in an earlier segment
+#define FIND_CANCEL_INTERVAL 256
+
+void find_job_run(void *arg)
+{
+    ParallelFind *pf = ((FindJob *)arg)->find;
+    const Checkpoints *cp = pf->list->checkpoints;
+    for (;;) {
+        size_t seg = __atomic_fetch_add(&pf->next_segment, 1,
+                                        __ATOMIC_RELAXED);
+        if (seg >= pf->segments
+            || seg > __atomic_load_n(&pf->best, __ATOMIC_RELAXED))
+            return;
+        Node *i = seg == 0 ? pf->list->head : cp->nodes[seg - 1];
+        Node *end = seg + 1 < pf->segments ? cp->nodes[seg] : NULL;
+        size_t scanned = 0;
+        for (; i != end; i = i->next) {
+            if (node_key_equal(i, pf->data, pf->len, pf->hash)) {
+                pthread_mutex_lock(&pf->lock);
+                if (seg < pf->best) {
+                    __atomic_store_n(&pf->best, seg, __ATOMIC_RELAXED);
+                    pf->found = i;
+                }
+                pthread_mutex_unlock(&pf->lock);
+                break;
+            }
+            if (++scanned % FIND_CANCEL_INTERVAL == 0
+                && seg > __atomic_load_n(&pf->best, __ATOMIC_RELAXED))
+                break;
+        }
+    }
+}
+
+// Like find, but scans the segments between the checkpoints of 'list' (see
+// list_checkpoints_attach) on the workers of 'pool'. Once a match turns up
+// the segments after it are abandoned, and the match in the earliest segment
+// wins, so the result is always the node find would return. Falls back to
+// find when the list has a hash index, no checkpoints or only one segment.
+// The list must not be modified during the call.
+// Return pointer to node if found.
+// Return NULL if not found or if given arguments are NULL.
+Node *find_parallel(List *list, const char *data, WorkerPool *pool)
+{
+    if (list == NULL || data == NULL || pool == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    if (list->index != NULL || !checkpoints_ready(list)
+        || list->checkpoints->count == 0 || pool->count < 2)
+        return find(list, data);
+
+    ParallelFind pf;
+    pf.list = list;
+    pf.data = data;
+    pf.len = strlen(data);
+    pf.hash = hash_bytes(data, pf.len);
+    pf.segments = list->checkpoints->count + 1;
+    pf.next_segment = 0;
+    pf.best = SIZE_MAX;
+    pf.found = NULL;
+    pthread_mutex_init(&pf.lock, NULL);
+    FindJob *jobs = malloc(pool->count * sizeof(*jobs));
+    if (jobs == NULL) {
+        print_error(ALLOC_FAIL);
+        pthread_mutex_destroy(&pf.lock);
+        return find(list, data);
+    }
+    int i;
+    for (i = 0; i < pool->count; ++i) {
+        jobs[i].task.run = find_job_run;
+        jobs[i].task.arg = &jobs[i];
+        jobs[i].find = &pf;
+        worker_pool_submit(pool, &jobs[i].task);
+    }
+    worker_pool_wait(pool);
+    free(jobs);
+    pthread_mutex_destroy(&pf.lock);
+    return pf.found;
+}
+
+// Called once per node by list_for_each. It must neither change the node nor
+// link or unlink nodes: the hash index, skip index and checkpoints of the
+// list are all keyed on the current contents. Use list_map to produce
+// changed strings.
+typedef void (*NodeVisit)(const Node *node, void *ctx);
+
+// Called once per node by list_map. Returns a malloc'd string, which the
+// matching node of the output list takes ownership of, or NULL on failure.
+typedef char *(*NodeMap)(const Node *node, void *ctx);
+
+// Call 'fn' on every node of 'list', in order.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_for_each(List *list, NodeVisit fn, void *ctx)
+{
+    if (list == NULL || fn == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *i;
+    for (i = list->head; i != NULL; i = i->next)
+        fn(i, ctx);
+    return 0;
+}
+
+// Output of list_map for one stretch of the source list
+typedef struct {
+    Node *head;
+    Node *last;
+    size_t count;
+} MapChain;
+
+// Map the nodes from 'first' up to (not including) 'end' into a fresh chain.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful; the partial chain is kept in 'out'
+// for the caller to free.
+int map_chain(const Node *first, const Node *end, NodeMap fn, void *ctx,
+              MapChain *out)
+{
+    out->head = NULL;
+    out->last = NULL;
+    out->count = 0;
+    const Node *i;
+    for (i = first; i != end; i = i->next) {
+        Node *n = malloc(sizeof(*n));
+        char *data = n ? fn(i, ctx) : NULL;
+        if (data == NULL) {
+            print_error(ALLOC_FAIL);
+            free(n);
+            return ALLOC_FAIL;
+        }
+        n->data = data;
+        n->kind = NODE_HEAP;
+        n->checkpoint = 0;
+        node_set_key(n, strlen(data));
+        n->prev = out->last;
+        n->next = NULL;
+        if (out->last != NULL)
+            out->last->next = n;
+        else
+            out->head = n;
+        out->last = n;
+        ++out->count;
+    }
+    return 0;
+}
+
+// Append the chain 'c' to 'list', keeping any index up to date.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int adopt_map_chain(List *list, MapChain *c)
+{
+    if (c->head == NULL)
+        return 0;
+    Node *n;
+    for (n = c->head; n != NULL; n = n->next) {
+        int ret = list_track_link(list, n);
+        if (ret != 0) {
+            Node *undo;
+            for (undo = c->head; undo != n; undo = undo->next)
+                list_track_unlink(list, undo);
+            return ret;
+        }
+    }
+    c->head->prev = list->last;
+    if (list->last != NULL)
+        list->last->next = c->head;
+    else
+        list->head = c->head;
+    list->last = c->last;
+    return 0;
+}
+
+// Free the nodes of a chain that never made it into a list
+void free_map_chain(MapChain *c)
+{
+    Node *n = c->head;
+    while (n != NULL) {
+        Node *tmp = n->next;
+        free(n->data);
+        free(n);
+        n = tmp;
+    }
+    c->head = NULL;
+}
+
+// Initialize 'dst' as a new list holding fn(node) for every node of 'src',
+// in the same order.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful; 'dst' is then left empty.
+int list_map(const List *src, List *dst, NodeMap fn, void *ctx)
+{
+    if (src == NULL || dst == NULL || fn == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    init_empty_list(dst);
+    MapChain c;
+    int ret = map_chain(src->head, NULL, fn, ctx, &c);
+    if (ret == 0)
+        ret = adopt_map_chain(dst, &c);
+    if (ret != 0)
+        free_map_chain(&c);
+    return ret;
+}
+
+// Nodes per unit of work in the parallel walks
+#define WALK_SEGMENT_LEN 64
+
+typedef struct ParallelWalk ParallelWalk;
+
+// One worker of a parallel walk. Its share of the segments is the range
+// [lo, hi), packed into one word as hi << 32 | lo so that the owner (taking
+// from lo) and thieves (taking the upper half from hi) can each claim work
+// with a single compare-and-swap.
+typedef struct {
+    Task task;
+    ParallelWalk *walk;
+    uint64_t range;
+    int id;
+} WalkJob;
+
+struct ParallelWalk {
+    Node **starts;    // segment i runs from starts[i] up to starts[i + 1]
+    size_t segments;
+    WalkJob *jobs;
+    int count;
+    NodeVisit visit;  // for list_for_each_parallel
+    NodeMap map;      // for list_map_parallel
+    void *ctx;
+    MapChain *chains; // list_map_parallel output, one per segment
+    int failed;
+};
+
+#define WALK_RANGE(lo, hi) ((uint64_t)(hi) << 32 | (uint64_t)(lo))
+
+void walk_segment(ParallelWalk *walk, size_t seg)
+{
+    Node *end = seg + 1 < walk->segments ? walk->starts[seg + 1] : NULL;
+    if (walk->map != NULL) {
+        if (map_chain(walk->starts[seg], end, walk->map, walk->ctx,
+                      &walk->chains[seg]) != 0)
+            __atomic_store_n(&walk->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    Node *i;
+    for (i = walk->starts[seg]; i != end; i = i->next)
+        walk->visit(i, walk->ctx);
+}
+
+// Move the upper half of some other worker's range into 'self', which must
+// be empty.
+// Returns 1 if anything was stolen.
+int walk_steal(WalkJob *self)
+{
+    ParallelWalk *walk = self->walk;
+    int k;
+    for (k = 1; k < walk->count; ++k) {
+        WalkJob *victim = &walk->jobs[(self->id + k) % walk->count];
+        uint64_t r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+        while (lo < hi) {
+            uint32_t mid = hi - (hi - lo + 1) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &r,
+                                            WALK_RANGE(lo, mid), 0,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&self->range, WALK_RANGE(mid, hi),
+                                 __ATOMIC_RELEASE);
+                return 1;
+            }
+            lo = (uint32_t)r;
+            hi = (uint32_t)(r >> 32);
+        }
+    }
+    return 0;
+}
+
+void walk_job_run(void *arg)
+{
+    WalkJob *self = arg;
+    do {
+        uint64_t r = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+        uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+        while (lo < hi) {
+            if (__atomic_compare_exchange_n(&self->range, &r,
+                                            WALK_RANGE(lo + 1, hi), 0,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE))
+                walk_segment(self->walk, lo);
+            r = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+            lo = (uint32_t)r;
+            hi = (uint32_t)(r >> 32);
+        }
+    } while (walk_steal(self));
+}
+
+// Cut 'list' into segments of WALK_SEGMENT_LEN nodes, hand each worker of
+// 'pool' an equal run of them and wait until all are processed; idle
+// workers steal from busy ones.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int parallel_walk(const List *list, ParallelWalk *walk, WorkerPool *pool)
+{
+    walk->segments = (list->size + WALK_SEGMENT_LEN - 1) / WALK_SEGMENT_LEN;
+    if (walk->segments > UINT32_MAX) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    walk->count = pool->count;
+    walk->failed = 0;
+    walk->starts = malloc(walk->segments * sizeof(*walk->starts));
+    walk->jobs = malloc(walk->count * sizeof(*walk->jobs));
+    if (walk->starts == NULL || walk->jobs == NULL) {
+        print_error(ALLOC_FAIL);
+        free(walk->starts);
+        free(walk->jobs);
+        return ALLOC_FAIL;
+    }
+    size_t pos = 0;
+    Node *n;
+    for (n = list->head; n != NULL; n = n->next, ++pos) {
+        if (pos % WALK_SEGMENT_LEN == 0)
+            walk->starts[pos / WALK_SEGMENT_LEN] = n;
+    }
+    int i;
+    for (i = 0; i < walk->count; ++i) {
+        WalkJob *job = &walk->jobs[i];
+        job->walk = walk;
+        job->id = i;
+        job->range = WALK_RANGE(walk->segments * i / walk->count,
+                                walk->segments * (i + 1) / walk->count);
+        job->task.run = walk_job_run;
+        job->task.arg = job;
+    }
+    // Publish every range before any worker can try to steal
+    for (i = 0; i < walk->count; ++i)
+        worker_pool_submit(pool, &walk->jobs[i].task);
+    worker_pool_wait(pool);
+    free(walk->starts);
+    free(walk->jobs);
+    return 0;
+}
+
+// Like list_for_each, but runs 'fn' on the workers of 'pool', so nodes are
+// visited concurrently and in no particular order. The list must not be
+// modified during the call.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int list_for_each_parallel(List *list, NodeVisit fn, void *ctx,
+                           WorkerPool *pool)
+{
+    if (list == NULL || fn == NULL || pool == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (pool->count < 2 || list->size <= WALK_SEGMENT_LEN)
+        return list_for_each(list, fn, ctx);
+    ParallelWalk walk;
+    walk.visit = fn;
+    walk.map = NULL;
+    walk.ctx = ctx;
+    walk.chains = NULL;
+    return parallel_walk(list, &walk, pool);
+}
+
+// Like list_map, but runs 'fn' on the workers of 'pool'. The output list is
+// still in source order.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful; 'dst' is then left empty.
+int list_map_parallel(const List *src, List *dst, NodeMap fn, void *ctx,
+                      WorkerPool *pool)
+{
+    if (src == NULL || dst == NULL || fn == NULL || pool == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (pool->count < 2 || src->size <= WALK_SEGMENT_LEN)
+        return list_map(src, dst, fn, ctx);
+    init_empty_list(dst);
+    size_t segments = (src->size + WALK_SEGMENT_LEN - 1) / WALK_SEGMENT_LEN;
+    ParallelWalk walk;
+    walk.visit = NULL;
+    walk.map = fn;
+    walk.ctx = ctx;
+    walk.chains = calloc(segments, sizeof(*walk.chains));
+    if (walk.chains == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    int ret = parallel_walk(src, &walk, pool);
+    if (ret == 0 && walk.failed)
+        ret = ALLOC_FAIL;
+    size_t i = 0;
+    while (i < segments && ret == 0) {
+        ret = adopt_map_chain(dst, &walk.chains[i]);
+        if (ret == 0)
+            ++i;
+    }
+    if (ret != 0) {
+        // Chains before 'i' were adopted; drop them with the rest
+        dealloc_list(dst);
+        init_empty_list(dst);
+        for (; i < segments; ++i)
+            free_map_chain(&walk.chains[i]);
+    }
+    free(walk.chains);
+    return ret;
+}
+
+
+// =========== List definition and API end =========== //
+
+
+// =========== Unrolled list definition and API start =========== //
+
+// An unrolled list keeps up to ULIST_BLOCK_LEN strings per block, so a walk
+// takes one pointer hop per block instead of one per string, and find can
+// reject most strings by their hash without leaving the block. Sized so that
+// a block is a few cache lines.
+#define ULIST_BLOCK_LEN 16
+
+typedef struct UBlock UBlock;
+struct UBlock {
+    UBlock *prev;
+    UBlock *next;
+    int count;
+    uint32_t hashes[ULIST_BLOCK_LEN];
+    char *items[ULIST_BLOCK_LEN];
+};
+
+typedef struct {
+    UBlock *head;
+    UBlock *last;
+} UList;
+
+// A position in a UList: the string at 'index' in 'block'. Any insertion or
+// removal invalidates positions into the blocks it touches.
+typedef struct {
+    UBlock *block;
+    int index;
+} UPos;
+
+// Allocate an empty block.
+// Returns pointer to new block if successful.
+// Return NULL if unsuccessful.
+UBlock *make_ublock()
+{
+    UBlock *b = malloc(sizeof(*b));
+    if (b == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    b->prev = NULL;
+    b->next = NULL;
+    b->count = 0;
+    return b;
+}
+
+// Link block 'b' into 'list' after 'at', or at the front if 'at' is NULL
+void ulist_link_block(UList *list, UBlock *at, UBlock *b)
+{
+    b->prev = at;
+    b->next = at ? at->next : list->head;
+    if (b->next != NULL)
+        b->next->prev = b;
+    else
+        list->last = b;
+    if (at != NULL)
+        at->next = b;
+    else
+        list->head = b;
+}
+
+// Unlink block 'b' from 'list' and free it
+void ulist_unlink_block(UList *list, UBlock *b)
+{
+    if (b->prev != NULL)
+        b->prev->next = b->next;
+    else
+        list->head = b->next;
+    if (b->next != NULL)
+        b->next->prev = b->prev;
+    else
+        list->last = b->prev;
+    free(b);
+}
+
+// Store a copy of 'data' at 'index' in 'b', shifting later strings up. 'b'
+// must have room.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ublock_insert(UBlock *b, int index, const char *data)
+{
+    size_t len = strlen(data);
+    char *copy = malloc(len + 1);
+    if (copy == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    memcpy(copy, data, len + 1);
+    int tail = b->count - index;
+    memmove(&b->items[index + 1], &b->items[index], tail * sizeof(b->items[0]));
+    memmove(&b->hashes[index + 1], &b->hashes[index],
+            tail * sizeof(b->hashes[0]));
+    b->items[index] = copy;
+    b->hashes[index] = hash_bytes(data, len);
+    ++b->count;
+    return 0;
+}
+
+// Insert a copy of 'data' so that it ends up at 'index' in block 'b' (with
+// 0 <= index <= b->count), splitting 'b' in half first if it is full.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_insert_at(UList *list, UBlock *b, int index, const char *data)
+{
+    if (b->count == ULIST_BLOCK_LEN) {
+        UBlock *upper = make_ublock();
+        if (upper == NULL)
+            return ALLOC_FAIL;
+        int half = ULIST_BLOCK_LEN / 2;
+        upper->count = ULIST_BLOCK_LEN - half;
+        memcpy(upper->items, &b->items[half],
+               upper->count * sizeof(b->items[0]));
+        memcpy(upper->hashes, &b->hashes[half],
+               upper->count * sizeof(b->hashes[0]));
+        b->count = half;
+        ulist_link_block(list, b, upper);
+        if (index > half) {
+            b = upper;
+            index -= half;
+        }
+    }
+    return ublock_insert(b, index, data);
+}
+
+// Inserts a copy of 'data' into 'list' after the string at 'pos'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_insert_after(UList *list, UPos pos, const char *data)
+{
+    if (list == NULL || pos.block == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    return ulist_insert_at(list, pos.block, pos.index + 1, data);
+}
+
+// Inserts a copy of 'data' into 'list' before the string at 'pos'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_insert_before(UList *list, UPos pos, const char *data)
+{
+    if (list == NULL || pos.block == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    return ulist_insert_at(list, pos.block, pos.index, data);
+}
+
+// Inserts a copy of 'data' at the front of the list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_insert_front(UList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (list->head == NULL) {
+        UBlock *b = make_ublock();
+        if (b == NULL)
+            return ALLOC_FAIL;
+        ulist_link_block(list, NULL, b);
+    }
+    return ulist_insert_at(list, list->head, 0, data);
+}
+
+// Inserts a copy of 'data' at the end of the list. Appending to a full last
+// block starts a new block rather than splitting, so appended lists stay
+// densely packed.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_insert_end(UList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (list->last == NULL || list->last->count == ULIST_BLOCK_LEN) {
+        UBlock *b = make_ublock();
+        if (b == NULL)
+            return ALLOC_FAIL;
+        ulist_link_block(list, list->last, b);
+    }
+    return ublock_insert(list->last, list->last->count, data);
+}
+
+// Removes the string at 'pos' from 'list'. Empty blocks are freed, and a
+// block that falls below a quarter full absorbs its successor when both fit.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int ulist_remove(UList *list, UPos pos)
+{
+    if (list == NULL || pos.block == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+
+    UBlock *b = pos.block;
+    free(b->items[pos.index]);
+    int tail = b->count - pos.index - 1;
+    memmove(&b->items[pos.index], &b->items[pos.index + 1],
+            tail * sizeof(b->items[0]));
+    memmove(&b->hashes[pos.index], &b->hashes[pos.index + 1],
+            tail * sizeof(b->hashes[0]));
+    --b->count;
+
+    if (b->count == 0) {
+        ulist_unlink_block(list, b);
+    } else if (b->count < ULIST_BLOCK_LEN / 4 && b->next != NULL
+               && b->count + b->next->count <= ULIST_BLOCK_LEN * 3 / 4) {
+        UBlock *n = b->next;
+        memcpy(&b->items[b->count], n->items, n->count * sizeof(n->items[0]));
+        memcpy(&b->hashes[b->count], n->hashes,
+               n->count * sizeof(n->hashes[0]));
+        b->count += n->count;
+        ulist_unlink_block(list, n);
+    }
+    return 0;
+}
+
+// Find the first string in 'list' equal to 'data'.
+// Return its position if found.
+// Return a position with a NULL block if not found or if given arguments are
+// NULL.
+UPos ulist_find(const UList *list, const char *data)
+{
+    UPos pos = { NULL, 0 };
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return pos;
+    }
+
+    size_t len = strlen(data);
+    uint32_t hash = hash_bytes(data, len);
+    UBlock *b = list->head;
+    while (b != NULL) {
+        int i;
+        for (i = 0; i < b->count; ++i) {
+            if (b->hashes[i] == hash && strcmp(b->items[i], data) == 0) {
+                pos.block = b;
+                pos.index = i;
+                return pos;
+            }
+        }
+        b = b->next;
+    }
+    return pos;
+}
+
+// Deallocate all dynamic memory associated with 'list'
+void dealloc_ulist(UList *list)
+{
+    if (list == NULL)
+        return;
+    UBlock *b = list->head;
+    while (b != NULL) {
+        UBlock *tmp = b->next;
+        int i;
+        for (i = 0; i < b->count; ++i)
+            free(b->items[i]);
+        free(b);
+        b = tmp;
+    }
+    list->head = NULL;
+    list->last = NULL;
+}
+
+// Unrolled counterpart of init_list: copies 'data_len' strings into 'list',
+// packing the blocks full.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_ulist(UList *list, const char *data[], int data_len)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (data_len < 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+
+    list->head = NULL;
+    list->last = NULL;
+    int i;
+    for (i = 0; i < data_len; ++i) {
+        if (ulist_insert_end(list, data[i]) != 0) {
+            dealloc_ulist(list);
+            return ALLOC_FAIL;
+        }
+    }
+    return 0;
+}
+
+// =========== Unrolled list definition and API end =========== //
+
+
+// =========== Compact list definition and API start =========== //
+
+// A compact list keeps its nodes in one growable array and links them with
+// 32-bit indices instead of pointers, halving the link overhead of Node. A
+// freshly built list is laid out in order, so walking it is close to a
+// sequential scan. Indices stay valid across growth (pointers would not).
+#define CLIST_NIL UINT32_MAX
+#define CLIST_MIN_CAPACITY 16
+
+typedef struct {
+    uint32_t prev;
+    uint32_t next; // next free slot while the slot is unused
+    char *data;    // NULL while the slot is unused
+} CNode;
+
+typedef struct {
+    CNode *nodes;
+    uint32_t capacity;
+    uint32_t used;      // slots handed out so far, live or freed
+    uint32_t head;
+    uint32_t last;
+    uint32_t free_head; // most recently freed slot
+} CList;
+
+// Whether 'index' names a live node of 'list'
+int clist_valid(const CList *list, uint32_t index)
+{
+    return index < list->used && list->nodes[index].data != NULL;
+}
+
+// Take a slot for a copy of 'data', reusing freed slots first and growing the
+// array when there are none. The slot is not linked.
+// Returns the slot index if successful.
+// Returns CLIST_NIL if unsuccessful.
+uint32_t clist_make_node(CList *list, const char *data)
+{
+    uint32_t index;
+    if (list->free_head != CLIST_NIL) {
+        index = list->free_head;
+        list->free_head = list->nodes[index].next;
+    } else {
+        if (list->used == list->capacity) {
+            if (list->capacity >= CLIST_NIL / 2) {
+                print_error(ALLOC_FAIL);
+                return CLIST_NIL;
+            }
+            uint32_t capacity = list->capacity ? list->capacity * 2
+                                               : CLIST_MIN_CAPACITY;
+            CNode *nodes = realloc(list->nodes, capacity * sizeof(*nodes));
+            if (nodes == NULL) {
+                print_error(ALLOC_FAIL);
+                return CLIST_NIL;
+            }
+            list->nodes = nodes;
+            list->capacity = capacity;
+        }
+        index = list->used++;
+    }
+
+    size_t bytes = strlen(data) + 1;
+    char *copy = malloc(bytes);
+    if (copy == NULL) {
+        print_error(ALLOC_FAIL);
+        list->nodes[index].data = NULL;
+        list->nodes[index].next = list->free_head;
+        list->free_head = index;
+        return CLIST_NIL;
+    }
+    memcpy(copy, data, bytes);
+    list->nodes[index].data = copy;
+    list->nodes[index].prev = CLIST_NIL;
+    list->nodes[index].next = CLIST_NIL;
+    return index;
+}
+
+// Inserts a copy of 'data' into 'list' after node 'node'.
+// Returns the new node's index if successful.
+// Returns CLIST_NIL if unsuccessful.
+uint32_t clist_insert_after(CList *list, uint32_t node, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return CLIST_NIL;
+    }
+    if (!clist_valid(list, node)) {
+        print_error(INDEX_INVALID);
+        return CLIST_NIL;
+    }
+
+    uint32_t new_node = clist_make_node(list, data);
+    if (new_node == CLIST_NIL)
+        return CLIST_NIL;
+    CNode *n = list->nodes;
+    n[new_node].prev = node;
+    n[new_node].next = n[node].next;
+    if (n[node].next == CLIST_NIL)
+        list->last = new_node;
+    else
+        n[n[node].next].prev = new_node;
+    n[node].next = new_node;
+    return new_node;
+}
+
+// Inserts a copy of 'data' into 'list' before node 'node'.
+// Returns the new node's index if successful.
+// Returns CLIST_NIL if unsuccessful.
+uint32_t clist_insert_before(CList *list, uint32_t node, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return CLIST_NIL;
+    }
+    if (!clist_valid(list, node)) {
+        print_error(INDEX_INVALID);
+        return CLIST_NIL;
+    }
+
+    uint32_t new_node = clist_make_node(list, data);
+    if (new_node == CLIST_NIL)
+        return CLIST_NIL;
+    CNode *n = list->nodes;
+    n[new_node].next = node;
+    n[new_node].prev = n[node].prev;
+    if (n[node].prev == CLIST_NIL)
+        list->head = new_node;
+    else
+        n[n[node].prev].next = new_node;
+    n[node].prev = new_node;
+    return new_node;
+}
+
+// Inserts a copy of 'data' at the front of the list.
+// Returns the new node's index if successful.
+// Returns CLIST_NIL if unsuccessful.
+uint32_t clist_insert_front(CList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return CLIST_NIL;
+    }
+    if (list->head != CLIST_NIL)
+        return clist_insert_before(list, list->head, data);
+
+    uint32_t new_node = clist_make_node(list, data);
+    if (new_node != CLIST_NIL) {
+        list->head = new_node;
+        list->last = new_node;
+    }
+    return new_node;
+}
+
+// Inserts a copy of 'data' at the end of the list.
+// Returns the new node's index if successful.
+// Returns CLIST_NIL if unsuccessful.
+uint32_t clist_insert_end(CList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return CLIST_NIL;
+    }
+    if (list->last == CLIST_NIL)
+        return clist_insert_front(list, data);
+    return clist_insert_after(list, list->last, data);
+}
+
+// Removes node 'node' from 'list' and puts its slot on the free list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int clist_remove(CList *list, uint32_t node)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (!clist_valid(list, node)) {
+        print_error(INDEX_INVALID);
+        return INDEX_INVALID;
+    }
+
+    CNode *n = list->nodes;
+    if (n[node].prev == CLIST_NIL)
+        list->head = n[node].next;
+    else
+        n[n[node].prev].next = n[node].next;
+    if (n[node].next == CLIST_NIL)
+        list->last = n[node].prev;
+    else
+        n[n[node].next].prev = n[node].prev;
+
+    free(n[node].data);
+    n[node].data = NULL;
+    n[node].next = list->free_head;
+    list->free_head = node;
+    return 0;
+}
+
+// Find a node in 'list' with contents 'data'.
+// Return its index if found.
+// Return CLIST_NIL if not found or if given arguments are NULL.
+uint32_t clist_find(const CList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return CLIST_NIL;
+    }
+
+    uint32_t i = list->head;
+    while (i != CLIST_NIL) {
+        if (strcmp(list->nodes[i].data, data) == 0)
+            return i;
+        i = list->nodes[i].next;
+    }
+    return CLIST_NIL;
+}
+
+// Rewrite the node array in list order and drop the free slots, so that a
+// walk is a purely sequential scan again after heavy churn. All previously
+// returned indices are invalidated.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int clist_compact(CList *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (list->used == 0)
+        return 0;
+
+    CNode *nodes = malloc(list->capacity * sizeof(*nodes));
+    if (nodes == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    uint32_t count = 0;
+    uint32_t i = list->head;
+    while (i != CLIST_NIL) {
+        nodes[count].data = list->nodes[i].data;
+        nodes[count].prev = count == 0 ? CLIST_NIL : count - 1;
+        nodes[count].next = count + 1;
+        ++count;
+        i = list->nodes[i].next;
+    }
+    free(list->nodes);
+    list->nodes = nodes;
+    list->used = count;
+    list->free_head = CLIST_NIL;
+    list->head = count ? 0 : CLIST_NIL;
+    list->last = count ? count - 1 : CLIST_NIL;
+    if (count != 0)
+        nodes[count - 1].next = CLIST_NIL;
+    return 0;
+}
+
+// Deallocate all dynamic memory associated with 'list'
+void dealloc_clist(CList *list)
+{
+    if (list == NULL)
+        return;
+    uint32_t i;
+    for (i = 0; i < list->used; ++i)
+        free(list->nodes[i].data);
+    free(list->nodes);
+    list->nodes = NULL;
+    list->capacity = 0;
+    list->used = 0;
+    list->head = CLIST_NIL;
+    list->last = CLIST_NIL;
+    list->free_head = CLIST_NIL;
+}
+
+// Compact counterpart of init_list: copies 'data_len' strings into 'list'
+// in one array sized up front.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_clist(CList *list, const char *data[], int data_len)
+{
+    if (data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (data_len < 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+
+    list->nodes = NULL;
+    list->capacity = 0;
+    list->used = 0;
+    list->head = CLIST_NIL;
+    list->last = CLIST_NIL;
+    list->free_head = CLIST_NIL;
+    if (data_len > 0) {
+        list->nodes = malloc(data_len * sizeof(*list->nodes));
+        if (list->nodes == NULL) {
+            print_error(ALLOC_FAIL);
+            return ALLOC_FAIL;
+        }
+        list->capacity = data_len;
+    }
+
+    int i;
+    for (i = 0; i < data_len; ++i) {
+        if (clist_insert_end(list, data[i]) == CLIST_NIL) {
+            dealloc_clist(list);
+            return ALLOC_FAIL;
+        }
+    }
+    return 0;
+}
+
+// =========== Compact list definition and API end =========== //
+
+
+// =========== Concurrent list definition and API start =========== //
+
+// A List behind a reader-writer lock: any number of finds run in parallel,
+// inserts and removals run alone. Nodes come from make_node_cached and are
+// allocated and freed outside the lock. Self-organizing lists (find_adaptive)
+// are not supported, since their finds write.
+typedef struct {
+    List list;
+    pthread_rwlock_t lock;
+} RwList;
+
+// Concurrent counterpart of init_list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_rwlist(RwList *list, const char *data[], int data_len)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    int ret = init_list(&list->list, data, data_len);
+    if (ret != 0)
+        return ret;
+    if (pthread_rwlock_init(&list->lock, NULL) != 0) {
+        print_error(ALLOC_FAIL);
+        dealloc_list(&list->list);
+        return ALLOC_FAIL;
+    }
+    return 0;
+}
+
+// Inserts a copy of 'data' at the front of the list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int rwlist_insert_front(RwList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *new_node = make_node_cached(data);
+    if (new_node == NULL)
+        return ALLOC_FAIL;
+    pthread_rwlock_wrlock(&list->lock);
+    int ret = insert_front(&list->list, new_node);
+    pthread_rwlock_unlock(&list->lock);
+    if (ret != 0)
+        release_node(&list->list, new_node);
+    return ret;
+}
+
+// Inserts a copy of 'data' at the end of the list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int rwlist_insert_end(RwList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *new_node = make_node_cached(data);
+    if (new_node == NULL)
+        return ALLOC_FAIL;
+    pthread_rwlock_wrlock(&list->lock);
+    int ret = insert_end(&list->list, new_node);
+    pthread_rwlock_unlock(&list->lock);
+    if (ret != 0)
+        release_node(&list->list, new_node);
+    return ret;
+}
+
+// Inserts a copy of 'data' after the first node holding 'key'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int rwlist_insert_after(RwList *list, const char *key, const char *data)
+{
+    if (list == NULL || key == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *new_node = make_node_cached(data);
+    if (new_node == NULL)
+        return ALLOC_FAIL;
+    pthread_rwlock_wrlock(&list->lock);
+    Node *at = find(&list->list, key);
+    int ret = at ? insert_after(&list->list, at, new_node) : NOT_FOUND;
+    pthread_rwlock_unlock(&list->lock);
+    if (ret != 0)
+        release_node(&list->list, new_node);
+    return ret;
+}
+
+// Removes the first node holding 'data'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int rwlist_remove(RwList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    pthread_rwlock_wrlock(&list->lock);
+    // Unlink under the lock, free after dropping it
+    Node *node = find(&list->list, data);
+    if (node != NULL)
+        unlink_node(&list->list, node);
+    pthread_rwlock_unlock(&list->lock);
+    if (node == NULL)
+        return NOT_FOUND;
+    release_node(&list->list, node);
+    return 0;
+}
+
+// Whether some node holds 'data'. Runs concurrently with other readers.
+int rwlist_contains(RwList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    pthread_rwlock_rdlock(&list->lock);
+    int found = find(&list->list, data) != NULL;
+    pthread_rwlock_unlock(&list->lock);
+    return found;
+}
+
+// Call 'fn' on the first node holding 'data' while the read lock is held.
+// 'fn' must not modify the list.
+// Returns 1 if a node was found, 0 otherwise.
+int rwlist_find_apply(RwList *list, const char *data,
+                      void (*fn)(const Node *node, void *ctx), void *ctx)
+{
+    if (list == NULL || data == NULL || fn == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    pthread_rwlock_rdlock(&list->lock);
+    Node *node = find(&list->list, data);
+    if (node != NULL)
+        fn(node, ctx);
+    pthread_rwlock_unlock(&list->lock);
+    return node != NULL;
+}
+
+// Deallocate all dynamic memory associated with 'list'. No other thread may
+// be using it.
+void dealloc_rwlist(RwList *list)
+{
+    if (list == NULL)
+        return;
+    dealloc_list(&list->list);
+    pthread_rwlock_destroy(&list->lock);
+}
+
+// =========== Concurrent list definition and API end =========== //
+
+
+// =========== Lock-free list definition and API start =========== //
+
+// Sorted, duplicate-free, singly linked list after Harris and Michael:
+// insert and remove are single CAS operations on 'next' links, and a node is
+// first logically deleted by setting the low bit of its own 'next' link,
+// which stops anyone from linking behind it. Readers and writers protect the
+// nodes they touch with hazard pointers, so a removed node is only freed once
+// no thread can still be looking at it.
+#define LF_MARK ((uintptr_t)1)
+#define LF_HAZARDS 3          // current node, its successor, its predecessor
+#define LF_RETIRE_THRESHOLD 64
+
+typedef struct LfNode LfNode;
+struct LfNode {
+    uintptr_t next; // LfNode *, with LF_MARK set once the node is deleted
+    char data[];
+};
+
+// Per-thread hazard pointers and list of removed nodes waiting to be freed
+typedef struct LfThread LfThread;
+struct LfThread {
+    LfNode *hazard[LF_HAZARDS];
+    LfThread *next;      // registry link, never changes once published
+    int active;          // owned by a registered thread
+    LfNode **retired;
+    size_t retired_count;
+    size_t retired_capacity;
+    LfNode *deferred;    // retired when 'retired' couldn't grow, see lf_defer
+};
+
+typedef struct {
+    uintptr_t head;      // LfNode *, never marked
+    LfThread *threads;   // registry of hazard records, grows only
+} LfList;
+
+LfNode *lf_ptr(uintptr_t link)
+{
+    return (LfNode *)(link & ~LF_MARK);
+}
+
+// Publish 'node' as hazardous in slot 'slot' of 't'. The store must be
+// visible before the caller re-validates the link it read 'node' from.
+void lf_protect(LfThread *t, int slot, LfNode *node)
+{
+    __atomic_store_n(&t->hazard[slot], node, __ATOMIC_SEQ_CST);
+}
+
+uintptr_t lf_load(uintptr_t *link)
+{
+    return __atomic_load_n(link, __ATOMIC_SEQ_CST);
+}
+
+int lf_cas(uintptr_t *link, uintptr_t expected, uintptr_t desired)
+{
+    return __atomic_compare_exchange_n(link, &expected, desired, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Initialize an empty lock-free list
+void init_lflist(LfList *list)
+{
+    list->head = 0;
+    list->threads = NULL;
+}
+
+// Get a hazard record for the calling thread, reusing a released one if
+// possible. Every thread must register before touching 'list'.
+// Returns pointer to record if successful.
+// Return NULL if unsuccessful.
+LfThread *lflist_thread_register(LfList *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    LfThread *t;
+    for (t = __atomic_load_n(&list->threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&t->active, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return t;
+    }
+
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    t->active = 1;
+    t->next = __atomic_load_n(&list->threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&list->threads, &t->next, t, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return t;
+}
+
+// Whether any registered thread holds a hazard pointer to 'node'
+int lf_hazardous(LfList *list, LfNode *node)
+{
+    LfThread *other;
+    for (other = __atomic_load_n(&list->threads, __ATOMIC_ACQUIRE);
+         other != NULL; other = other->next) {
+        int h;
+        for (h = 0; h < LF_HAZARDS; ++h) {
+            if (__atomic_load_n(&other->hazard[h], __ATOMIC_SEQ_CST) == node)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Chain a retired node onto 't'->deferred through its own 'next' link.
+// The link keeps LF_MARK, so to anyone still holding the node it looks
+// deleted as before, and no CAS expecting a live link can succeed on it.
+void lf_defer(LfThread *t, LfNode *node)
+{
+    __atomic_store_n(&node->next, (uintptr_t)t->deferred | LF_MARK,
+                     __ATOMIC_RELEASE);
+    t->deferred = node;
+}
+
+// Free every node retired by 't' that no thread has marked hazardous
+void lf_scan(LfList *list, LfThread *t)
+{
+    size_t kept = 0;
+    size_t i;
+    for (i = 0; i < t->retired_count; ++i) {
+        LfNode *node = t->retired[i];
+        if (lf_hazardous(list, node))
+            t->retired[kept++] = node;
+        else
+            free(node);
+    }
+    t->retired_count = kept;
+
+    LfNode *node = t->deferred;
+    t->deferred = NULL;
+    while (node != NULL) {
+        LfNode *tmp = lf_ptr(node->next);
+        if (lf_hazardous(list, node))
+            lf_defer(t, node);
+        else
+            free(node);
+        node = tmp;
+    }
+}
+
+// Hand an unlinked node to the reclamation scheme
+void lf_retire(LfList *list, LfThread *t, LfNode *node)
+{
+    if (t->retired_count == t->retired_capacity) {
+        size_t capacity = t->retired_capacity ? t->retired_capacity * 2
+                                              : LF_RETIRE_THRESHOLD;
+        LfNode **retired = realloc(t->retired, capacity * sizeof(*retired));
+        if (retired == NULL) {
+            // No room to record it; the caller may still hold it, so leave
+            // it for the next scan rather than waiting here
+            print_error(ALLOC_FAIL);
+            lf_defer(t, node);
+            return;
+        }
+        t->retired = retired;
+        t->retired_capacity = capacity;
+    }
+    t->retired[t->retired_count++] = node;
+    if (t->retired_count >= LF_RETIRE_THRESHOLD)
+        lf_scan(list, t);
+}
+
+void lf_clear_hazards(LfThread *t)
+{
+    int h;
+    for (h = 0; h < LF_HAZARDS; ++h)
+        __atomic_store_n(&t->hazard[h], NULL, __ATOMIC_RELEASE);
+}
+
+// Give up the calling thread's hazard record. Nodes it retired are freed
+// once safe, here or by a later owner of the record.
+void lflist_thread_unregister(LfList *list, LfThread *t)
+{
+    if (list == NULL || t == NULL)
+        return;
+    lf_clear_hazards(t);
+    lf_scan(list, t);
+    __atomic_store_n(&t->active, 0, __ATOMIC_RELEASE);
+}
+
+// Find the position of 'data': '*prev' is the link that points at '*cur',
+// the first node not ordered before 'data', and '*next' is its successor.
+// Deleted nodes met on the way are unlinked and retired. On return '*cur'
+// and the node holding '*prev' are protected by hazard pointers.
+// Returns 1 if '*cur' holds 'data', 0 otherwise.
+int lf_search(LfList *list, LfThread *t, const char *data, uintptr_t **prev,
+              LfNode **cur, LfNode **next)
+{
+retry:
+    *prev = &list->head;
+    *cur = lf_ptr(lf_load(*prev));
+    for (;;) {
+        if (*cur == NULL)
+            return 0;
+        lf_protect(t, 0, *cur);
+        if (lf_load(*prev) != (uintptr_t)*cur)
+            goto retry;
+        uintptr_t link = lf_load(&(*cur)->next);
+        *next = lf_ptr(link);
+        lf_protect(t, 1, *next);
+        if (lf_load(&(*cur)->next) != link)
+            goto retry;
+
+        if (link & LF_MARK) {
+            // '*cur' is deleted; help unlink it before moving on
+            if (!lf_cas(*prev, (uintptr_t)*cur, (uintptr_t)*next))
+                goto retry;
+            lf_retire(list, t, *cur);
+            *cur = *next;
+            continue;
+        }
+        int cmp = strcmp((*cur)->data, data);
+        if (lf_load(*prev) != (uintptr_t)*cur)
+            goto retry;
+        if (cmp >= 0)
+            return cmp == 0;
+        *prev = &(*cur)->next;
+        lf_protect(t, 2, *cur);
+        *cur = *next;
+    }
+}
+
+// Inserts a copy of 'data' into 'list' at its sorted position.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int lflist_insert(LfList *list, LfThread *t, const char *data)
+{
+    if (list == NULL || t == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    size_t bytes = strlen(data) + 1;
+    LfNode *node = malloc(sizeof(*node) + bytes);
+    if (node == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    memcpy(node->data, data, bytes);
+
+    int ret;
+    for (;;) {
+        uintptr_t *prev;
+        LfNode *cur, *next;
+        if (lf_search(list, t, data, &prev, &cur, &next)) {
+            free(node);
+            ret = DUPLICATE;
+            break;
+        }
+        node->next = (uintptr_t)cur;
+        if (lf_cas(prev, (uintptr_t)cur, (uintptr_t)node)) {
+            ret = 0;
+            break;
+        }
+    }
+    lf_clear_hazards(t);
+    return ret;
+}
+
+// Removes the node holding 'data' from 'list'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int lflist_remove(LfList *list, LfThread *t, const char *data)
+{
+    if (list == NULL || t == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+
+    int ret;
+    for (;;) {
+        uintptr_t *prev;
+        LfNode *cur, *next;
+        if (!lf_search(list, t, data, &prev, &cur, &next)) {
+            ret = NOT_FOUND;
+            break;
+        }
+        // Logical deletion: whoever sets the mark owns the removal
+        if (!lf_cas(&cur->next, (uintptr_t)next, (uintptr_t)next | LF_MARK))
+            continue;
+        if (lf_cas(prev, (uintptr_t)cur, (uintptr_t)next))
+            lf_retire(list, t, cur);
+        else
+            lf_search(list, t, data, &prev, &cur, &next); // unlinks it
+        ret = 0;
+        break;
+    }
+    lf_clear_hazards(t);
+    return ret;
+}
+
+// Whether 'list' holds 'data'
+int lflist_contains(LfList *list, LfThread *t, const char *data)
+{
+    if (list == NULL || t == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    uintptr_t *prev;
+    LfNode *cur, *next;
+    int found = lf_search(list, t, data, &prev, &cur, &next);
+    lf_clear_hazards(t);
+    return found;
+}
+
+// Deallocate all dynamic memory associated with 'list', including hazard
+// records and retired nodes. No other thread may be using it.
+void dealloc_lflist(LfList *list)
+{
+    if (list == NULL)
+        return;
+    LfNode *n = lf_ptr(list->head);
+    while (n != NULL) {
+        LfNode *tmp = lf_ptr(n->next);
+        free(n);
+        n = tmp;
+    }
+    LfThread *t = list->threads;
+    while (t != NULL) {
+        LfThread *tmp = t->next;
+        size_t i;
+        for (i = 0; i < t->retired_count; ++i)
+            free(t->retired[i]);
+        free(t->retired);
+        while (t->deferred != NULL) {
+            LfNode *node = t->deferred;
+            t->deferred = lf_ptr(node->next);
+            free(node);
+        }
+        free(t);
+        t = tmp;
+    }
+    init_lflist(list);
+}
+
+// =========== Lock-free list definition and API end =========== //
+
+
+// =========== Epoch reclamation definition and API start =========== //
+
+// Epoch-based reclamation for a List that is read without locks. Readers
+// bracket their accesses with epoch_enter/epoch_exit and use
+// find_concurrent; a writer (writers still serialize among themselves)
+// unlinks nodes with remove_node_deferred, which only retires them. A node
+// retired in epoch e is released once the global epoch reaches e + 2, since
+// by then every reader that could have seen it has left its critical
+// section. Retired nodes wait on per-thread lists, one per epoch modulo 3,
+// chained through their 'prev' pointers, which readers never follow.
+#define EPOCH_ACTIVE ((uint64_t)1)  // low bit of EpochThread.state
+#define EPOCH_RETIRE_THRESHOLD 64    // retired nodes before trying to collect
+
+typedef struct EpochDomain EpochDomain;
+typedef struct EpochThread EpochThread;
+struct EpochThread {
+    uint64_t state;        // (epoch << 1) | EPOCH_ACTIVE while reading
+    EpochDomain *domain;
+    EpochThread *next;     // registry link, never changes once published
+    int registered;
+    Node *limbo[3];        // retired nodes, indexed by epoch % 3
+    uint64_t limbo_epoch[3];
+    size_t retired_count;
+};
+
+struct EpochDomain {
+    List *list;            // where retired nodes are released
+    uint64_t epoch;
+    EpochThread *threads;  // registry of thread records, grows only
+};
+
+// Initialize reclamation for 'list'
+void init_epoch_domain(EpochDomain *domain, List *list)
+{
+    domain->list = list;
+    domain->epoch = 0;
+    domain->threads = NULL;
+}
+
+// Get a record for the calling thread, reusing a released one if possible.
+// Returns pointer to record if successful.
+// Return NULL if unsuccessful.
+EpochThread *epoch_thread_register(EpochDomain *domain)
+{
+    if (domain == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    EpochThread *t;
+    for (t = __atomic_load_n(&domain->threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&t->registered, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return t;
+    }
+
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    t->domain = domain;
+    t->registered = 1;
+    t->next = __atomic_load_n(&domain->threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&domain->threads, &t->next, t, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return t;
+}
+
+// Give up the calling thread's record. Nodes it retired stay queued until a
+// later owner of the record collects them or the domain is deallocated.
+void epoch_thread_unregister(EpochThread *t)
+{
+    if (t == NULL)
+        return;
+    __atomic_store_n(&t->state, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&t->registered, 0, __ATOMIC_RELEASE);
+}
+
+// Start a read-side critical section: nodes reachable from here on stay
+// allocated until the matching epoch_exit
+void epoch_enter(EpochThread *t)
+{
+    uint64_t epoch = __atomic_load_n(&t->domain->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&t->state, (epoch << 1) | EPOCH_ACTIVE, __ATOMIC_SEQ_CST);
+}
+
+// End a read-side critical section
+void epoch_exit(EpochThread *t)
+{
+    __atomic_store_n(&t->state, 0, __ATOMIC_RELEASE);
+}
+
+// Move the global epoch forward if every thread inside a critical section
+// has already observed the current one
+void epoch_try_advance(EpochDomain *domain)
+{
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+    EpochThread *t;
+    for (t = __atomic_load_n(&domain->threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        uint64_t state = __atomic_load_n(&t->state, __ATOMIC_SEQ_CST);
+        if ((state & EPOCH_ACTIVE) && (state >> 1) != epoch)
+            return;
+    }
+    __atomic_compare_exchange_n(&domain->epoch, &epoch, epoch + 1, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Release the retired nodes in limbo slot 'slot' of 't'
+void epoch_release_slot(EpochThread *t, int slot)
+{
+    Node *n = t->limbo[slot];
+    while (n != NULL) {
+        Node *tmp = n->prev;
+        release_node(t->domain->list, n);
+        --t->retired_count;
+        n = tmp;
+    }
+    t->limbo[slot] = NULL;
+}
+
+// Try to advance the epoch, then release every node 't' retired at least
+// two epochs ago, in one batch
+void epoch_reclaim(EpochThread *t)
+{
+    epoch_try_advance(t->domain);
+    uint64_t epoch = __atomic_load_n(&t->domain->epoch, __ATOMIC_ACQUIRE);
+    int slot;
+    for (slot = 0; slot < 3; ++slot) {
+        if (t->limbo[slot] != NULL && t->limbo_epoch[slot] + 2 <= epoch)
+            epoch_release_slot(t, slot);
+    }
+}
+
+// Queue the unlinked 'node' for release once no reader can reach it
+void epoch_retire(EpochThread *t, Node *node)
+{
+    uint64_t epoch = __atomic_load_n(&t->domain->epoch, __ATOMIC_ACQUIRE);
+    int slot = epoch % 3;
+    // Anything left in this slot is from epoch - 3 or earlier
+    if (t->limbo[slot] != NULL && t->limbo_epoch[slot] != epoch)
+        epoch_release_slot(t, slot);
+    node->prev = t->limbo[slot];
+    t->limbo[slot] = node;
+    t->limbo_epoch[slot] = epoch;
+    if (++t->retired_count >= EPOCH_RETIRE_THRESHOLD)
+        epoch_reclaim(t);
+}
+
+// Removes 'node' from the domain's list without freeing it under readers.
+// Must not run concurrently with other writers of the list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int remove_node_deferred(EpochThread *t, Node *node)
+{
+    if (t == NULL || node == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    int ret = unlink_node(t->domain->list, node);
+    if (ret != 0)
+        return ret;
+    epoch_retire(t, node);
+    return 0;
+}
+
+// Reader-side find: like find, but safe while a writer inserts and removes
+// nodes. Only walks the chain, never the hash or skip index. Must be called
+// between epoch_enter and epoch_exit, and the result is only valid until
+// epoch_exit.
+// Return pointer to node if found.
+// Return NULL if not found or if given arguments are NULL.
+Node *find_concurrent(const List *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+
+    size_t len = strlen(data);
+    uint32_t hash = hash_bytes(data, len);
+    Node *i = LINK_READ(list->head);
+    while (i != NULL) {
+        if (node_key_equal(i, data, len, hash))
+            return i;
+        i = LINK_READ(i->next);
+    }
+    return NULL;
+}
+
+// Release every retired node and free all thread records. No thread may be
+// using the domain or its list.
+void dealloc_epoch_domain(EpochDomain *domain)
+{
+    if (domain == NULL)
+        return;
+    EpochThread *t = domain->threads;
+    while (t != NULL) {
+        EpochThread *tmp = t->next;
+        int slot;
+        for (slot = 0; slot < 3; ++slot)
+            epoch_release_slot(t, slot);
+        free(t);
+        t = tmp;
+    }
+    domain->threads = NULL;
+}
+
+// =========== Epoch reclamation definition and API end =========== //
+
+
+// =========== RCU definition and API start =========== //
+
+// Quiescent-state-based RCU for read-mostly lists. Readers use
+// find_concurrent (or walk 'next' with LINK_READ) with no locks and no
+// atomic read-modify-writes; between lookups, at points where they hold no
+// node pointers, they announce a quiescent state with rcu_quiescent, which is
+// a plain store. Writers serialize on the domain's lock, publish changes
+// through the release stores in the insert functions, and hand unlinked
+// nodes to remove_node_rcu. Those are released in batches by rcu_reclaim
+// once every registered reader has passed a quiescent state, i.e. after a
+// grace period.
+#define RCU_OFFLINE UINT64_MAX
+#define RCU_RECLAIM_THRESHOLD 64
+
+typedef struct RcuThread RcuThread;
+struct RcuThread {
+    uint64_t seen;     // grace period counter at the last quiescent state
+    RcuThread *next;   // registry link, never changes once published
+    int registered;
+};
+
+typedef struct {
+    List *list;
+    uint64_t gp;             // bumped once per grace period
+    RcuThread *threads;      // registry of reader records, grows only
+    pthread_mutex_t writer;  // serializes writers and the deferred queue
+    Node *deferred;          // unlinked nodes, chained through 'prev'
+    size_t deferred_count;
+} RcuDomain;
+
+// Initialize RCU for 'list'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_rcu_domain(RcuDomain *domain, List *list)
+{
+    if (domain == NULL || list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (pthread_mutex_init(&domain->writer, NULL) != 0) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    domain->list = list;
+    domain->gp = 1;
+    domain->threads = NULL;
+    domain->deferred = NULL;
+    domain->deferred_count = 0;
+    return 0;
+}
+
+// Register the calling thread as a reader. It starts out online.
+// Returns pointer to record if successful.
+// Return NULL if unsuccessful.
+RcuThread *rcu_thread_register(RcuDomain *domain)
+{
+    if (domain == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    uint64_t gp = __atomic_load_n(&domain->gp, __ATOMIC_ACQUIRE);
+    RcuThread *t;
+    for (t = __atomic_load_n(&domain->threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&t->registered, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&t->seen, gp, __ATOMIC_SEQ_CST);
+            return t;
+        }
+    }
+
+    t = malloc(sizeof(*t));
+    if (t == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    t->seen = gp;
+    t->registered = 1;
+    t->next = __atomic_load_n(&domain->threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&domain->threads, &t->next, t, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return t;
+}
+
+// Announce that the calling reader holds no node pointers right now
+void rcu_quiescent(RcuDomain *domain, RcuThread *t)
+{
+    __atomic_store_n(&t->seen, __atomic_load_n(&domain->gp, __ATOMIC_RELAXED),
+                     __ATOMIC_RELEASE);
+}
+
+// Stop taking part in grace periods, e.g. before blocking for a long time.
+// The reader must not touch the list until rcu_thread_online.
+void rcu_thread_offline(RcuThread *t)
+{
+    __atomic_store_n(&t->seen, RCU_OFFLINE, __ATOMIC_RELEASE);
+}
+
+void rcu_thread_online(RcuDomain *domain, RcuThread *t)
+{
+    __atomic_store_n(&t->seen, __atomic_load_n(&domain->gp, __ATOMIC_RELAXED),
+                     __ATOMIC_SEQ_CST);
+}
+
+void rcu_thread_unregister(RcuThread *t)
+{
+    if (t == NULL)
+        return;
+    rcu_thread_offline(t);
+    __atomic_store_n(&t->registered, 0, __ATOMIC_RELEASE);
+}
+
+// Wait for a grace period: every node unlinked before this call is
+// unreachable for all readers once it returns. Must not be called by a
+// registered reader that is online.
+void synchronize_rcu(RcuDomain *domain)
+{
+    uint64_t target = __atomic_add_fetch(&domain->gp, 1, __ATOMIC_SEQ_CST);
+    RcuThread *t;
+    for (t = __atomic_load_n(&domain->threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        for (;;) {
+            uint64_t seen = __atomic_load_n(&t->seen, __ATOMIC_ACQUIRE);
+            if (seen >= target || !__atomic_load_n(&t->registered,
+                                                   __ATOMIC_ACQUIRE))
+                break;
+            sched_yield();
+        }
+    }
+}
+
+void rcu_write_lock(RcuDomain *domain)
+{
+    pthread_mutex_lock(&domain->writer);
+}
+
+void rcu_write_unlock(RcuDomain *domain)
+{
+    pthread_mutex_unlock(&domain->writer);
+}
+
+// Release all nodes deferred so far, after one grace period. Waits without
+// holding the writer lock, so other writers can keep going.
+void rcu_reclaim(RcuDomain *domain)
+{
+    rcu_write_lock(domain);
+    Node *batch = domain->deferred;
+    domain->deferred = NULL;
+    domain->deferred_count = 0;
+    rcu_write_unlock(domain);
+    if (batch == NULL)
+        return;
+
+    synchronize_rcu(domain);
+    rcu_write_lock(domain);
+    while (batch != NULL) {
+        Node *tmp = batch->prev;
+        release_node(domain->list, batch);
+        batch = tmp;
+    }
+    rcu_write_unlock(domain);
+}
+
+// Unlinks 'node' from the domain's list and defers its release until a grace
+// period has passed. The caller must hold the writer lock.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int remove_node_rcu(RcuDomain *domain, Node *node)
+{
+    if (domain == NULL || node == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    int ret = unlink_node(domain->list, node);
+    if (ret != 0)
+        return ret;
+    node->prev = domain->deferred;
+    domain->deferred = node;
+    ++domain->deferred_count;
+    return 0;
+}
+
+// Whether enough nodes are deferred that a writer should call rcu_reclaim
+// after dropping the writer lock
+int rcu_reclaim_due(RcuDomain *domain)
+{
+    return __atomic_load_n(&domain->deferred_count, __ATOMIC_RELAXED)
+           >= RCU_RECLAIM_THRESHOLD;
+}
+
+// Release deferred nodes and reader records. No thread may be using the
+// domain.
+void dealloc_rcu_domain(RcuDomain *domain)
+{
+    if (domain == NULL)
+        return;
+    while (domain->deferred != NULL) {
+        Node *tmp = domain->deferred->prev;
+        release_node(domain->list, domain->deferred);
+        domain->deferred = tmp;
+    }
+    RcuThread *t = domain->threads;
+    while (t != NULL) {
+        RcuThread *tmp = t->next;
+        free(t);
+        t = tmp;
+    }
+    domain->threads = NULL;
+    pthread_mutex_destroy(&domain->writer);
+}
+
+// =========== RCU definition and API end =========== //
+
+
+// =========== Sharded list definition and API start =========== //
+
+// N independent lists, each behind its own lock on its own cache lines. A
+// string always lives in the shard picked by its hash, so concurrent inserts
+// of different strings rarely touch the same lock or 'last' pointer, and a
+// lookup only has to search one shard. Nodes come from make_node_cached, so
+// the allocator doesn't become the shared bottleneck instead. Every node is
+// stamped with its insertion sequence number, so ShardedIter can merge the
+// shards back into global insertion order without touching them.
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    List list;
+} ListShard;
+
+typedef struct {
+    ListShard *shards;
+    size_t count;
+    _Alignas(64) uint64_t seq; // next insertion stamp
+} ShardedList;
+
+// Set up 'list' with 'shards' empty shards, or one per online CPU if
+// 'shards' is 0.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_sharded_list(ShardedList *list, size_t shards)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (shards == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        shards = cpus > 0 ? (size_t)cpus : 1;
+    }
+    list->shards = aligned_alloc(_Alignof(ListShard),
+                                 shards * sizeof(*list->shards));
+    if (list->shards == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    list->count = shards;
+    list->seq = 0;
+    size_t i;
+    for (i = 0; i < shards; ++i) {
+        pthread_mutex_init(&list->shards[i].lock, NULL);
+        init_empty_list(&list->shards[i].list);
+    }
+    return 0;
+}
+
+ListShard *shard_for(ShardedList *list, uint32_t hash)
+{
+    return &list->shards[hash % list->count];
+}
+
+// Insertion stamp of a node made by sharded_node_make, kept between the Node
+// and its string
+uint64_t *sharded_node_seq(const Node *node)
+{
+    return (uint64_t *)(node + 1);
+}
+
+// Allocate a node for 'data' with room for its insertion stamp, from the
+// calling thread's node cache when a size class fits.
+// Returns pointer to new node if successful.
+// Return NULL if unsuccessful.
+Node *sharded_node_make(const char *data)
+{
+    size_t bytes = strlen(data) + 1;
+    size_t room = sizeof(uint64_t) + bytes;
+    int c = node_cache_class(room);
+    Node *node = c >= 0 ? node_cache_get(c) : malloc(sizeof(*node) + room);
+    if (node == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    node->kind = c >= 0 ? NODE_CACHED : NODE_INLINE;
+    node->checkpoint = 0;
+    node->size_class = c >= 0 ? (unsigned char)c : 0;
+    node->prev = NULL;
+    node->next = NULL;
+    node->data = (char *)sharded_node_seq(node) + sizeof(uint64_t);
+    memcpy(node->data, data, bytes);
+    node_set_key(node, bytes - 1);
+    return node;
+}
+
+// Inserts a copy of 'data' at the end of its shard.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sharded_insert(ShardedList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *new_node = sharded_node_make(data);
+    if (new_node == NULL)
+        return ALLOC_FAIL;
+    ListShard *shard = shard_for(list, new_node->hash);
+    pthread_mutex_lock(&shard->lock);
+    // Stamped under the shard lock, so stamps only grow along each shard
+    *sharded_node_seq(new_node) =
+        __atomic_fetch_add(&list->seq, 1, __ATOMIC_RELAXED);
+    int ret = insert_end(&shard->list, new_node);
+    pthread_mutex_unlock(&shard->lock);
+    if (ret != 0)
+        release_node(&shard->list, new_node);
+    return ret;
+}
+
+// Removes the first node holding 'data' from its shard.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sharded_remove(ShardedList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    ListShard *shard = shard_for(list, hash_bytes(data, strlen(data)));
+    pthread_mutex_lock(&shard->lock);
+    Node *node = find(&shard->list, data);
+    if (node != NULL)
+        unlink_node(&shard->list, node);
+    pthread_mutex_unlock(&shard->lock);
+    if (node == NULL)
+        return NOT_FOUND;
+    release_node(&shard->list, node);
+    return 0;
+}
+
+// Whether some shard holds 'data'; only its own shard is searched
+int sharded_contains(ShardedList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    ListShard *shard = shard_for(list, hash_bytes(data, strlen(data)));
+    pthread_mutex_lock(&shard->lock);
+    int found = find(&shard->list, data) != NULL;
+    pthread_mutex_unlock(&shard->lock);
+    return found;
+}
+
+// Total number of nodes over all shards
+size_t sharded_length(ShardedList *list)
+{
+    size_t total = 0;
+    size_t i;
+    for (i = 0; i < list->count; ++i) {
+        pthread_mutex_lock(&list->shards[i].lock);
+        total += list_length(&list->shards[i].list);
+        pthread_mutex_unlock(&list->shards[i].lock);
+    }
+    return total;
+}
+
+// Ordered walk over all shards. Every shard is already in stamp order, so
+// their heads are merged through a binary min-heap on the stamps, and all
+// shards stay locked from sharded_iter_begin to sharded_iter_end. An order by
+// comparator instead needs each shard sorted, which a read mustn't do to the
+// shards themselves: the walk then sorts and merges private copies, and the
+// shards are only locked while they are copied.
+typedef struct {
+    ShardedList *list;
+    NodeCompare cmp; // NULL for insertion order
+    void *ctx;
+    List *copies;    // sorted shard copies when 'cmp' is set, else NULL
+    Node **heap;     // current node of every non-exhausted shard
+    size_t count;    // nodes in 'heap'
+} ShardedIter;
+
+int sharded_iter_less(const ShardedIter *it, const Node *a, const Node *b)
+{
+    if (it->cmp != NULL)
+        return it->cmp(a, b, it->ctx) < 0;
+    return *sharded_node_seq(a) < *sharded_node_seq(b);
+}
+
+void sharded_iter_sift_down(ShardedIter *it, size_t i)
+{
+    for (;;) {
+        size_t least = i;
+        size_t child;
+        for (child = 2 * i + 1; child <= 2 * i + 2; ++child) {
+            if (child < it->count
+                && sharded_iter_less(it, it->heap[child], it->heap[least]))
+                least = child;
+        }
+        if (least == i)
+            return;
+        Node *tmp = it->heap[i];
+        it->heap[i] = it->heap[least];
+        it->heap[least] = tmp;
+        i = least;
+    }
+}
+
+// Sorted private copy of the shard 'shard' into 'copy', which is empty.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sharded_iter_copy(ShardedIter *it, ListShard *shard, List *copy)
+{
+    int ret = 0;
+    pthread_mutex_lock(&shard->lock);
+    Node *n;
+    for (n = shard->list.head; n != NULL && ret == 0; n = n->next) {
+        Node *dup = make_node_cached(n->data);
+        ret = dup != NULL ? insert_end(copy, dup) : ALLOC_FAIL;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if (ret == 0)
+        ret = sort_list(copy, it->cmp, it->ctx);
+    return ret;
+}
+
+// Prepare a walk over all shards, in insertion order if 'cmp' is NULL and in
+// 'cmp' order over a snapshot otherwise. The shards are never modified.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sharded_iter_begin(ShardedIter *it, ShardedList *list, NodeCompare cmp,
+                       void *ctx)
+{
+    if (it == NULL || list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    it->heap = malloc(list->count * sizeof(*it->heap));
+    it->copies = NULL;
+    if (it->heap != NULL && cmp != NULL)
+        it->copies = malloc(list->count * sizeof(*it->copies));
+    if (it->heap == NULL || (cmp != NULL && it->copies == NULL)) {
+        free(it->heap);
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    it->list = list;
+    it->cmp = cmp;
+    it->ctx = ctx;
+    it->count = 0;
+    size_t i;
+    for (i = 0; i < list->count; ++i) {
+        List *source = &list->shards[i].list;
+        if (cmp != NULL) {
+            init_empty_list(&it->copies[i]);
+            int ret = sharded_iter_copy(it, &list->shards[i], &it->copies[i]);
+            if (ret != 0) {
+                size_t j;
+                for (j = 0; j <= i; ++j)
+                    dealloc_list(&it->copies[j]);
+                free(it->copies);
+                free(it->heap);
+                return ret;
+            }
+            source = &it->copies[i];
+        } else {
+            // Always lock in shard order so that iterators can't deadlock
+            pthread_mutex_lock(&list->shards[i].lock);
+        }
+        if (source->head != NULL)
+            it->heap[it->count++] = source->head;
+    }
+    for (i = it->count / 2; i-- > 0;)
+        sharded_iter_sift_down(it, i);
+    return 0;
+}
+
+// Next node in merged order.
+// Return pointer to node, or NULL when the walk is over.
+Node *sharded_iter_next(ShardedIter *it)
+{
+    if (it->count == 0)
+        return NULL;
+    Node *top = it->heap[0];
+    if (top->next != NULL)
+        it->heap[0] = top->next;
+    else
+        it->heap[0] = it->heap[--it->count];
+    sharded_iter_sift_down(it, 0);
+    return top;
+}
+
+// Finish a walk, unlocking every shard or freeing the copies
+void sharded_iter_end(ShardedIter *it)
+{
+    size_t i;
+    for (i = it->list->count; i-- > 0;) {
+        if (it->copies != NULL)
+            dealloc_list(&it->copies[i]);
+        else
+            pthread_mutex_unlock(&it->list->shards[i].lock);
+    }
+    free(it->copies);
+    free(it->heap);
+}
+
+// Deallocate all dynamic memory associated with 'list'. No other thread may
+// be using it.
+void dealloc_sharded_list(ShardedList *list)
+{
+    if (list == NULL || list->shards == NULL)
+        return;
+    size_t i;
+    for (i = 0; i < list->count; ++i) {
+        dealloc_list(&list->shards[i].list);
+        pthread_mutex_destroy(&list->shards[i].lock);
+    }
+    free(list->shards);
+    list->shards = NULL;
+}
+
+// =========== Sharded list definition and API end =========== //
+
+
+// =========== Work queue definition and API start =========== //
+
+// Multi-producer multi-consumer FIFO after Michael and Scott's two-lock
+// queue: producers only take the tail lock and consumers only the head
+// lock, so pushes and pops don't contend with each other. 'head' is always a
+// dummy node and the first item sits in head->next. Popped strings are
+// handed to the caller, and the Node structs are recycled through a small
+// free list instead of going back to malloc.
+#define WQ_FREE_MAX 1024
+
+typedef struct {
+    _Alignas(64) pthread_mutex_t head_lock;
+    Node *head;
+    pthread_cond_t nonempty;  // waited on with head_lock held
+    int waiting;              // consumers blocked in a pop
+    int closed;
+    _Alignas(64) pthread_mutex_t tail_lock;
+    Node *tail;
+    _Alignas(64) pthread_mutex_t free_lock;
+    Node *free_nodes;         // recycled nodes, linked through 'next'
+    size_t free_count;
+} WorkQueue;
+
+// Initialize an empty queue.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_work_queue(WorkQueue *q)
+{
+    if (q == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *dummy = malloc(sizeof(*dummy));
+    if (dummy == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    dummy->next = NULL;
+    dummy->prev = NULL;
+    dummy->data = NULL;
+    dummy->kind = NODE_HEAP;
+    pthread_mutex_init(&q->head_lock, NULL);
+    pthread_mutex_init(&q->tail_lock, NULL);
+    pthread_mutex_init(&q->free_lock, NULL);
+    pthread_cond_init(&q->nonempty, NULL);
+    q->head = dummy;
+    q->tail = dummy;
+    q->waiting = 0;
+    q->closed = 0;
+    q->free_nodes = NULL;
+    q->free_count = 0;
+    return 0;
+}
+
+// Get a node from the free list, or from malloc if it is empty
+Node *wq_get_node(WorkQueue *q)
+{
+    pthread_mutex_lock(&q->free_lock);
+    Node *n = q->free_nodes;
+    if (n != NULL) {
+        q->free_nodes = n->next;
+        --q->free_count;
+    }
+    pthread_mutex_unlock(&q->free_lock);
+    if (n == NULL) {
+        n = malloc(sizeof(*n));
+        if (n == NULL)
+            print_error(ALLOC_FAIL);
+    }
+    return n;
+}
+
+// Recycle the 'count' nodes chained from 'first' to 'last' through 'next'
+void wq_put_nodes(WorkQueue *q, Node *first, Node *last, size_t count)
+{
+    pthread_mutex_lock(&q->free_lock);
+    if (q->free_count + count <= WQ_FREE_MAX) {
+        last->next = q->free_nodes;
+        q->free_nodes = first;
+        q->free_count += count;
+        first = NULL;
+    }
+    pthread_mutex_unlock(&q->free_lock);
+    while (first != NULL) {
+        Node *tmp = first == last ? NULL : first->next;
+        free(first);
+        first = tmp;
+    }
+}
+
+// Appends a copy of 'data' to the queue and wakes a blocked consumer.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int wq_push(WorkQueue *q, const char *data)
+{
+    if (q == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *n = wq_get_node(q);
+    if (n == NULL)
+        return ALLOC_FAIL;
+    size_t bytes = strlen(data) + 1;
+    n->data = malloc(bytes);
+    if (n->data == NULL) {
+        print_error(ALLOC_FAIL);
+        wq_put_nodes(q, n, n, 1);
+        return ALLOC_FAIL;
+    }
+    memcpy(n->data, data, bytes);
+    n->next = NULL;
+    n->kind = NODE_HEAP;
+    node_set_key(n, bytes - 1);
+
+    pthread_mutex_lock(&q->tail_lock);
+    __atomic_store_n(&q->tail->next, n, __ATOMIC_SEQ_CST);
+    q->tail = n;
+    pthread_mutex_unlock(&q->tail_lock);
+
+    // Pairs with the check in wq_wait: either the consumer sees the node or
+    // we see the consumer
+    if (__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&q->head_lock);
+        pthread_cond_signal(&q->nonempty);
+        pthread_mutex_unlock(&q->head_lock);
+    }
+    return 0;
+}
+
+// With head_lock held, wait until the queue is non-empty or closed.
+// Returns 1 if an item is available.
+int wq_wait(WorkQueue *q)
+{
+    for (;;) {
+        if (__atomic_load_n(&q->head->next, __ATOMIC_ACQUIRE) != NULL)
+            return 1;
+        if (q->closed)
+            return 0;
+        __atomic_add_fetch(&q->waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&q->head->next, __ATOMIC_SEQ_CST) == NULL
+            && !q->closed)
+            pthread_cond_wait(&q->nonempty, &q->head_lock);
+        __atomic_sub_fetch(&q->waiting, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Pop up to 'max' strings into 'out', in FIFO order, under a single
+// acquisition of the head lock. If 'block' is set, waits until at least one
+// string is available or the queue is closed. The caller owns the returned
+// strings and must free them.
+// Returns the number of strings stored in 'out'.
+size_t wq_pop_batch(WorkQueue *q, char **out, size_t max, int block)
+{
+    if (q == NULL || out == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    pthread_mutex_lock(&q->head_lock);
+    if (block && max > 0)
+        wq_wait(q);
+    Node *first = q->head;
+    Node *last = NULL;
+    Node *cur = first;
+    size_t count = 0;
+    while (count < max) {
+        Node *next = __atomic_load_n(&cur->next, __ATOMIC_ACQUIRE);
+        if (next == NULL)
+            break;
+        // 'next' becomes the new dummy; its string goes to the caller
+        out[count++] = next->data;
+        next->data = NULL;
+        last = cur;
+        cur = next;
+    }
+    q->head = cur;
+    pthread_mutex_unlock(&q->head_lock);
+
+    // Recycle the old dummy and every node emptied before the new one
+    if (count > 0)
+        wq_put_nodes(q, first, last, count);
+    return count;
+}
+
+// Pop the oldest string without waiting.
+// Returns the string, which the caller must free, or NULL if the queue is
+// empty.
+char *wq_try_pop(WorkQueue *q)
+{
+    char *data = NULL;
+    wq_pop_batch(q, &data, 1, 0);
+    return data;
+}
+
+// Pop the oldest string, waiting for one if the queue is empty.
+// Returns the string, which the caller must free, or NULL once the queue is
+// closed and drained.
+char *wq_pop(WorkQueue *q)
+{
+    char *data = NULL;
+    wq_pop_batch(q, &data, 1, 1);
+    return data;
+}
+
+// Wake every blocked consumer; pops on an empty closed queue return at once
+void wq_close(WorkQueue *q)
+{
+    pthread_mutex_lock(&q->head_lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->nonempty);
+    pthread_mutex_unlock(&q->head_lock);
+}
+
+// Deallocate all dynamic memory associated with 'q', including strings that
+// were never popped. No other thread may be using it.
+void dealloc_work_queue(WorkQueue *q)
+{
+    if (q == NULL)
+        return;
+    Node *n = q->head;
+    while (n != NULL) {
+        Node *tmp = n->next;
+        free(n->data);
+        free(n);
+        n = tmp;
+    }
+    n = q->free_nodes;
+    while (n != NULL) {
+        Node *tmp = n->next;
+        free(n);
+        n = tmp;
+    }
+    pthread_mutex_destroy(&q->head_lock);
+    pthread_mutex_destroy(&q->tail_lock);
+    pthread_mutex_destroy(&q->free_lock);
+    pthread_cond_destroy(&q->nonempty);
+}
+
+// =========== Work queue definition and API end =========== //
+
+
+// =========== Lock-coupled list definition and API start =========== //
+
+// A doubly linked list with a mutex in every node, so writers working on
+// different parts of the list run at the same time. Walks use lock coupling
+// (hand-over-hand): the next node is locked before the current one is
+// released, and locks are only ever taken front to back, which rules out
+// deadlock. A node can only be reached by locking its predecessor first, so
+// once a writer holds a node and its predecessor nobody else can be waiting
+// on it and it can be freed as soon as it is unlinked.
+typedef struct HNode {
+    struct HNode *prev;
+    struct HNode *next;
+    pthread_mutex_t lock;
+    char *data;
+    size_t len;
+    uint32_t hash;
+} HNode;
+
+typedef struct {
+    HNode head;               // sentinels; never hold data
+    HNode tail;
+    int size;                 // updated atomically
+} HList;
+
+// Initialize an empty list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_hlist(HList *list)
+{
+    if (list == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    list->head.prev = NULL;
+    list->head.next = &list->tail;
+    list->head.data = NULL;
+    list->tail.prev = &list->head;
+    list->tail.next = NULL;
+    list->tail.data = NULL;
+    pthread_mutex_init(&list->head.lock, NULL);
+    pthread_mutex_init(&list->tail.lock, NULL);
+    list->size = 0;
+    return 0;
+}
+
+// Allocate a node holding a copy of 'data'
+HNode *make_hnode(const char *data)
+{
+    HNode *node = malloc(sizeof(*node));
+    if (node == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    node->len = strlen(data);
+    node->data = malloc(node->len + 1);
+    if (node->data == NULL) {
+        print_error(ALLOC_FAIL);
+        free(node);
+        return NULL;
+    }
+    memcpy(node->data, data, node->len + 1);
+    node->hash = hash_bytes(data, node->len);
+    pthread_mutex_init(&node->lock, NULL);
+    return node;
+}
+
+void free_hnode(HNode *node)
+{
+    pthread_mutex_destroy(&node->lock);
+    free(node->data);
+    free(node);
+}
+
+// Link 'node' between the locked neighbours 'left' and 'right'
+void hlist_link(HList *list, HNode *left, HNode *node, HNode *right)
+{
+    node->prev = left;
+    node->next = right;
+    left->next = node;
+    right->prev = node;
+    __atomic_add_fetch(&list->size, 1, __ATOMIC_RELAXED);
+}
+
+// Walk from the head with lock coupling to the first node holding 'data'.
+// On success the node and its predecessor are returned locked, in '*cur'
+// and '*pred'. On failure nothing is left locked.
+// Returns 1 if a node was found.
+int hlist_seek(HList *list, const char *data, HNode **pred, HNode **cur)
+{
+    size_t len = strlen(data);
+    uint32_t hash = hash_bytes(data, len);
+    HNode *p = &list->head;
+    pthread_mutex_lock(&p->lock);
+    HNode *c = p->next;
+    pthread_mutex_lock(&c->lock);
+    while (c != &list->tail) {
+        if (c->hash == hash && c->len == len && bytes_equal(c->data, data, len)) {
+            *pred = p;
+            *cur = c;
+            return 1;
+        }
+        pthread_mutex_unlock(&p->lock);
+        p = c;
+        c = c->next;
+        pthread_mutex_lock(&c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+// Inserts a copy of 'data' at the front of the list.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hlist_insert_front(HList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    HNode *node = make_hnode(data);
+    if (node == NULL)
+        return ALLOC_FAIL;
+    HNode *left = &list->head;
+    pthread_mutex_lock(&left->lock);
+    HNode *right = left->next;
+    pthread_mutex_lock(&right->lock);
+    hlist_link(list, left, node, right);
+    pthread_mutex_unlock(&right->lock);
+    pthread_mutex_unlock(&left->lock);
+    return 0;
+}
+
+// Inserts a copy of 'data' after the first node holding 'key'. Only that
+// node and its successor stay locked while linking.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hlist_insert_after(HList *list, const char *key, const char *data)
+{
+    if (list == NULL || key == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    HNode *node = make_hnode(data);
+    if (node == NULL)
+        return ALLOC_FAIL;
+    HNode *pred, *cur;
+    if (!hlist_seek(list, key, &pred, &cur)) {
+        free_hnode(node);
+        return NOT_FOUND;
+    }
+    pthread_mutex_unlock(&pred->lock);
+    HNode *succ = cur->next;
+    pthread_mutex_lock(&succ->lock);
+    hlist_link(list, cur, node, succ);
+    pthread_mutex_unlock(&succ->lock);
+    pthread_mutex_unlock(&cur->lock);
+    return 0;
+}
+
+// Inserts a copy of 'data' before the first node holding 'key'. Only that
+// node and its predecessor stay locked while linking.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hlist_insert_before(HList *list, const char *key, const char *data)
+{
+    if (list == NULL || key == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    HNode *node = make_hnode(data);
+    if (node == NULL)
+        return ALLOC_FAIL;
+    HNode *pred, *cur;
+    if (!hlist_seek(list, key, &pred, &cur)) {
+        free_hnode(node);
+        return NOT_FOUND;
+    }
+    hlist_link(list, pred, node, cur);
+    pthread_mutex_unlock(&cur->lock);
+    pthread_mutex_unlock(&pred->lock);
+    return 0;
+}
+
+// Removes the first node holding 'data', locking it and its two neighbours.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int hlist_remove(HList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    HNode *pred, *cur;
+    if (!hlist_seek(list, data, &pred, &cur))
+        return NOT_FOUND;
+    HNode *succ = cur->next;
+    pthread_mutex_lock(&succ->lock);
+    pred->next = succ;
+    succ->prev = pred;
+    __atomic_sub_fetch(&list->size, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&succ->lock);
+    pthread_mutex_unlock(&cur->lock);
+    pthread_mutex_unlock(&pred->lock);
+    free_hnode(cur);
+    return 0;
+}
+
+// Whether some node holds 'data'
+int hlist_contains(HList *list, const char *data)
+{
+    if (list == NULL || data == NULL) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    HNode *pred, *cur;
+    if (!hlist_seek(list, data, &pred, &cur))
+        return 0;
+    pthread_mutex_unlock(&cur->lock);
+    pthread_mutex_unlock(&pred->lock);
+    return 1;
+}
+
+int hlist_length(HList *list)
+{
+    return __atomic_load_n(&list->size, __ATOMIC_RELAXED);
+}
+
+// Deallocate all dynamic memory associated with 'list'. No other thread may
+// be using it.
+void dealloc_hlist(HList *list)
+{
+    if (list == NULL)
+        return;
+    HNode *node = list->head.next;
+    while (node != &list->tail) {
+        HNode *tmp = node->next;
+        free_hnode(node);
+        node = tmp;
+    }
+    pthread_mutex_destroy(&list->head.lock);
+    pthread_mutex_destroy(&list->tail.lock);
+}
+
+// =========== Lock-coupled list definition and API end =========== //
+
+
+// =========== LRU cache definition and API start =========== //
+
+// String key to string value cache holding at most 'capacity' entries. The
+// entries are the nodes of a List with a hash index attached, most recently
+// used first, so get, put and evict are all O(1). Each node stores
+// "key\0value" in one block and its 'len' and 'hash' cover the key only,
+// which is what the index and find compare. Hits are relinked to the head
+// in place; a put that evicts reuses the tail node's block for the incoming
+// entry whenever it is big enough.
+typedef struct {
+    List list;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} LruCache;
+
+// Initialize an empty cache for up to 'capacity' entries.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_lru_cache(LruCache *cache, size_t capacity)
+{
+    if (cache == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (capacity == 0) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    init_empty_list(&cache->list);
+    int ret = list_index_attach(&cache->list);
+    if (ret != 0)
+        return ret;
+    cache->capacity = capacity;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    return 0;
+}
+
+// Bytes available for "key\0value\0" in the block behind 'node', or 0 if
+// its size isn't known
+size_t lru_entry_room(const Node *node)
+{
+    if (node->kind != NODE_CACHED)
+        return 0;
+    return (size_t)NODE_CACHE_MIN_BYTES << node->size_class;
+}
+
+// Store "key\0value\0" in 'node', which must have room for it
+void lru_entry_fill(Node *node, const char *key, size_t key_len,
+                    const char *value, size_t value_len)
+{
+    memcpy(node->data, key, key_len + 1);
+    memcpy(node->data + key_len + 1, value, value_len + 1);
+    node_set_key(node, key_len);
+}
+
+// Allocate an entry node with room for 'bytes' bytes of key and value, from
+// the calling thread's node cache when a size class fits.
+// Returns pointer to new node if successful.
+// Return NULL if unsuccessful.
+Node *lru_entry_make(size_t bytes)
+{
+    int c = node_cache_class(bytes);
+    Node *node = c >= 0 ? node_cache_get(c) : malloc(sizeof(*node) + bytes);
+    if (node == NULL) {
+        print_error(ALLOC_FAIL);
+        return NULL;
+    }
+    node->kind = c >= 0 ? NODE_CACHED : NODE_INLINE;
+    node->checkpoint = 0;
+    node->size_class = c >= 0 ? (unsigned char)c : 0;
+    node->data = (char *)(node + 1);
+    node->prev = NULL;
+    node->next = NULL;
+    return node;
+}
+
+// Look up 'key' and mark it most recently used.
+// Returns the cached value, valid until the next put on 'cache', or NULL on
+// a miss.
+const char *lru_get(LruCache *cache, const char *key)
+{
+    if (cache == NULL || key == NULL) {
+        print_error(NULL_PTR);
+        return NULL;
+    }
+    Node *hit = find(&cache->list, key);
+    if (hit == NULL) {
+        ++cache->misses;
+        return NULL;
+    }
+    ++cache->hits;
+    if (hit != cache->list.head)
+        list_move_before(&cache->list, hit, cache->list.head);
+    return hit->data + hit->len + 1;
+}
+
+// Map 'key' to a copy of 'value', making it the most recently used entry.
+// When the cache is full the least recently used entry is evicted and its
+// node reused.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int lru_put(LruCache *cache, const char *key, const char *value)
+{
+    if (cache == NULL || key == NULL || value == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    List *list = &cache->list;
+    size_t key_len = strlen(key);
+    size_t value_len = strlen(value);
+    size_t bytes = key_len + value_len + 2;
+
+    // Replace in place when the key is already cached
+    Node *node = find(list, key);
+    if (node != NULL && bytes <= lru_entry_room(node)) {
+        memcpy(node->data + key_len + 1, value, value_len + 1);
+        if (node != list->head)
+            list_move_before(list, node, list->head);
+        return 0;
+    }
+    if (node != NULL) {
+        unlink_node(list, node);
+    } else if (list->size >= cache->capacity) {
+        node = list->last;
+        unlink_node(list, node);
+        ++cache->evictions;
+    }
+
+    if (node != NULL && bytes > lru_entry_room(node)) {
+        release_node(list, node);
+        node = NULL;
+    }
+    if (node == NULL) {
+        node = lru_entry_make(bytes);
+        if (node == NULL)
+            return ALLOC_FAIL;
+    }
+    lru_entry_fill(node, key, key_len, value, value_len);
+    int ret = insert_front(list, node);
+    if (ret != 0)
+        release_node(list, node);
+    return ret;
+}
+
+// Drop 'key' from the cache.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int lru_remove(LruCache *cache, const char *key)
+{
+    if (cache == NULL || key == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    Node *node = find(&cache->list, key);
+    if (node == NULL)
+        return NOT_FOUND;
+    return remove_node(&cache->list, node);
+}
+
+// Deallocate all dynamic memory associated with 'cache'
+void dealloc_lru_cache(LruCache *cache)
+{
+    if (cache == NULL)
+        return;
+    dealloc_list(&cache->list);
+}
+
+// N independent caches, each behind its own lock, splitting the capacity
+// between them. A key always lives in the shard picked by the high bits of
+// its hash (the low bits pick its slot in the shard's index).
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    LruCache cache;
+} LruShard;
+
+typedef struct {
+    LruShard *shards;
+    size_t count;
+} ShardedLru;
+
+// Initialize 'shards' caches (one per CPU if 0) sharing 'capacity' entries.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int init_sharded_lru(ShardedLru *lru, size_t capacity, size_t shards)
+{
+    if (lru == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    if (shards == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        shards = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (capacity < shards) {
+        print_error(LEN_INVALID);
+        return LEN_INVALID;
+    }
+    lru->shards = aligned_alloc(_Alignof(LruShard),
+                                shards * sizeof(*lru->shards));
+    if (lru->shards == NULL) {
+        print_error(ALLOC_FAIL);
+        return ALLOC_FAIL;
+    }
+    size_t i;
+    for (i = 0; i < shards; ++i) {
+        size_t share = capacity / shards + (i < capacity % shards);
+        int ret = init_lru_cache(&lru->shards[i].cache, share);
+        if (ret != 0) {
+            while (i-- > 0) {
+                dealloc_lru_cache(&lru->shards[i].cache);
+                pthread_mutex_destroy(&lru->shards[i].lock);
+            }
+            free(lru->shards);
+            return ret;
+        }
+        pthread_mutex_init(&lru->shards[i].lock, NULL);
+    }
+    lru->count = shards;
+    return 0;
+}
+
+LruShard *lru_shard_for(ShardedLru *lru, const char *key)
+{
+    return &lru->shards[(hash_bytes(key, strlen(key)) >> 16) % lru->count];
+}
+
+// Copy the value cached for 'key' into 'out', which holds 'out_size'
+// bytes, truncating if needed, and mark it most recently used.
+// Returns 1 on a hit, 0 on a miss.
+int sharded_lru_get(ShardedLru *lru, const char *key, char *out,
+                    size_t out_size)
+{
+    if (lru == NULL || key == NULL || out == NULL || out_size == 0) {
+        print_error(NULL_PTR);
+        return 0;
+    }
+    LruShard *shard = lru_shard_for(lru, key);
+    pthread_mutex_lock(&shard->lock);
+    const char *value = lru_get(&shard->cache, key);
+    if (value != NULL) {
+        size_t len = strlen(value);
+        if (len >= out_size)
+            len = out_size - 1;
+        memcpy(out, value, len);
+        out[len] = '\0';
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return value != NULL;
+}
+
+// lru_put on the shard owning 'key'.
+// Returns 0 if successful.
+// Returns an error enum if unsuccessful.
+int sharded_lru_put(ShardedLru *lru, const char *key, const char *value)
+{
+    if (lru == NULL || key == NULL || value == NULL) {
+        print_error(NULL_PTR);
+        return NULL_PTR;
+    }
+    LruShard *shard = lru_shard_for(lru, key);
+    pthread_mutex_lock(&shard->lock);
+    int ret = lru_put(&shard->cache, key, value);
+    pthread_mutex_unlock(&shard->lock);
+    return ret;
+}
+
+// Deallocate all dynamic memory associated with 'lru'. No other thread may
+// be using it.
+void dealloc_sharded_lru(ShardedLru *lru)
+{
+    if (lru == NULL || lru->shards == NULL)
+        return;
+    size_t i;
+    for (i = 0; i < lru->count; ++i) {
+        dealloc_lru_cache(&lru->shards[i].cache);
+        pthread_mutex_destroy(&lru->shards[i].lock);
+    }
+    free(lru->shards);
+    lru->shards = NULL;
+}
+
+// =========== LRU cache definition and API end =========== //
+
+
+// =========== List test functions start =========== //
+
+const char *TEST_DATA[] = {
+    "ABC0",
+    "ABC1",
+    "ABC2",
+    "ABC3",
+    "ABC4",
+    "ABC5",
+    "ABC6",
+    "ABC7",
+    "ABC8",
+    "ABC9"
+};
+
+const char **TEST_DATA_NULL = NULL;
+
+const int DATA_LEN = sizeof(TEST_DATA) / sizeof(TEST_DATA[0]);
+const int DATA_LEN_NEGATIVE = -DATA_LEN;
+
+void test_print_list(List *list)
+{
+    Node *i = list->head;
+    puts("==== List start ====");
+    while (i != NULL) {
+        puts(i->data);
+        i = i->next;
+    }
+    puts("==== List end ====");
+}
+
+// For comparing integer values
+void assert_int_equal(int expected, int actual, const char *test_name)
+{
+    printf("%s: ", test_name);
+    if (actual != expected)
+        printf("FAIL: expected %d, got %d\n", expected, actual);
+    else
+        printf("PASS\n");
+}
+
+// For comparing Node pointer values
+void assert_node_ptr_equal(Node *expected, Node *actual, const char *test_name)
+{
+    printf("%s: ", test_name);
+    if (actual != expected)
+        printf("FAIL: expected %p, got %p\n", expected, actual);
+    else
+        printf("PASS\n");
+}
+
+// Call init_list with NULL 'data' argument
+void test_init_list_null_data()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA_NULL, DATA_LEN);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(NULL_PTR, init_ret, "test_init_list_null_data");
+}
+
+// Call init_list with negative 'data_len' argument
+void test_init_list_negative_data_len()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN_NEGATIVE);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(LEN_INVALID, init_ret, "test_init_list_negative_data_len");
+}
+
+// Call init_list with NULL 'data' argument
+void test_init_list_success()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, init_ret, "test_init_list_success");
+}
+
+// Insert a node after list head
+void test_insert_after_head()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_after(&list, list.head, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_after_head");
+}
+
+// Insert a node after a node somewhere in the middle of a list
+void test_insert_after_middle()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    int ins_ret = insert_after(&list, mid, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_after_middle");
+}
+
+// Insert a node after list last
+void test_insert_after_last()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_after(&list, list.last, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_after_last");
+}
+
+// Insert a node before list head
+void test_insert_before_head()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_before(&list, list.head, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_before_head");
+}
+
+// Insert a node before a node somewhere in the middle of a list
+void test_insert_before_middle()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    int ins_ret = insert_before(&list, mid, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_before_middle");
+}
+
+// Insert a node before list last
+void test_insert_before_last()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_before(&list, list.last, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_before_last");
+}
+
+// Test call to insert_front
+void test_insert_front_success()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_front(&list, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_front_success");
+}
+
+// Test call to insert_end
+void test_insert_end_success()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int ins_ret = insert_end(&list, make_node("zzzz"));
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, ins_ret, "test_insert_end_success");
+}
+
+// Remove the list head
+void test_remove_node_head()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int rem_ret = remove_node(&list, list.head);
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, rem_ret, "test_remove_node_head");
+}
+
+// Remove a node in the middle
+void test_remove_node_middle()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    int rem_ret = remove_node(&list, mid);
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, rem_ret, "test_remove_node_middle");
+}
+
+// Remove the list last
+void test_remove_node_last()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int rem_ret = remove_node(&list, list.last);
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+    assert_int_equal(0, rem_ret, "test_remove_node_last");
+}
+
+// Test find function when node is list head
+void test_find_head()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *t = find(&list, "ABC0");
+
+    assert_node_ptr_equal(NULL, t->prev, "test_find_head1");
+    assert_node_ptr_equal(list.head->next, t->next, "test_find_head2");
+    assert_int_equal(0, strcmp("ABC0", t->data), "test_find_head3");
+
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Test find function when node is somewhere in the middle
+void test_find_middle()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *t = find(&list, "ABC4");
+
+    Node *mid = list.head->next->next->next->next; // ABC4
+    assert_node_ptr_equal(mid->prev, t->prev, "test_find_middle1");
+    assert_node_ptr_equal(mid->next, t->next, "test_find_middle2");
+    assert_int_equal(0, strcmp("ABC4", t->data), "test_find_middle3");
+
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Test find function when node is list last
+void test_find_last()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    Node *t = find(&list, "ABC9");
+
+    assert_node_ptr_equal(list.last->prev, t->prev, "test_find_last1");
+    assert_node_ptr_equal(NULL, t->next, "test_find_last2");
+    assert_int_equal(0, strcmp("ABC9", t->data), "test_find_last3");
+
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Removed pool nodes are handed out again by the next allocation
+void test_node_pool_recycle()
+{
+    NodePool pool;
+    node_pool_init(&pool);
+    List list;
+    int init_ret = init_list_pooled(&list, &pool, TEST_DATA, DATA_LEN);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    remove_node(&list, mid);
+    Node *recycled = node_pool_make_node(&pool, "zzzz");
+    insert_end(&list, recycled);
+    assert_node_ptr_equal(mid, recycled, "test_node_pool_recycle1");
+    assert_int_equal(0, strcmp("zzzz", list.last->data),
+                     "test_node_pool_recycle2");
+    if (init_ret == 0)
+        dealloc_list(&list);
+    node_pool_dealloc(&pool);
+    assert_int_equal(0, init_ret, "test_node_pool_recycle3");
+}
+
+// Call node_pool_make_node with NULL 'pool' argument
+void test_node_pool_null_pool()
+{
+    Node *t = node_pool_make_node(NULL, "zzzz");
+    assert_node_ptr_equal(NULL, t, "test_node_pool_null_pool");
+}
+
+// Inline nodes keep their payload directly behind the node header
+void test_make_node_inline()
+{
+    Node *t = make_node_inline("zzzz");
+    assert_int_equal(1, t->data == (char *)(t + 1), "test_make_node_inline1");
+    assert_int_equal(0, strcmp("zzzz", t->data), "test_make_node_inline2");
+    free(t);
+}
+
+// Inline nodes mixed into a heap list are found and removed like any other
+void test_inline_node_find_remove()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    insert_after(&list, list.head, make_node_inline("zzzz"));
+    insert_end(&list, make_node_inline("yyyy"));
+    Node *t = find(&list, "zzzz");
+    assert_node_ptr_equal(list.head->next, t, "test_inline_node_find_remove1");
+    int rem_ret = remove_node(&list, t);
+    assert_int_equal(0, rem_ret, "test_inline_node_find_remove2");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// An attached index follows inserts and removals
+void test_index_find()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    int att_ret = list_index_attach(&list);
+    assert_int_equal(0, att_ret, "test_index_find1");
+    Node *mid = list.head->next->next->next->next; // ABC4
+    assert_node_ptr_equal(mid, find(&list, "ABC4"), "test_index_find2");
+    remove_node(&list, mid);
+    assert_node_ptr_equal(NULL, find(&list, "ABC4"), "test_index_find3");
+    insert_front(&list, make_node("zzzz"));
+    assert_node_ptr_equal(list.head, find(&list, "zzzz"), "test_index_find4");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// With duplicate contents the indexed find still returns the first match
+void test_index_find_duplicate()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    list_index_attach(&list);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    insert_end(&list, make_node("ABC4"));
+    insert_front(&list, make_node("ABC4"));
+    assert_node_ptr_equal(list.head, find(&list, "ABC4"),
+                          "test_index_find_duplicate1");
+    remove_node(&list, list.head);
+    assert_node_ptr_equal(mid, find(&list, "ABC4"),
+                          "test_index_find_duplicate2");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// An arena list is built from a single block
+void test_init_list_arena()
+{
+    List list;
+    int init_ret = init_list_arena(&list, TEST_DATA, DATA_LEN);
+    assert_int_equal(0, init_ret, "test_init_list_arena1");
+    assert_int_equal(0, strcmp("ABC9", list.last->data),
+                     "test_init_list_arena2");
+    assert_node_ptr_equal(list.head, &list.arena->nodes[0],
+                          "test_init_list_arena3");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Arena nodes can be removed and mixed with heap nodes
+void test_arena_remove_and_insert()
+{
+    List list;
+    int init_ret = init_list_arena(&list, TEST_DATA, DATA_LEN);
+    Node *mid = list.head->next->next->next->next; // ABC4
+    int rem_ret = remove_node(&list, mid);
+    assert_int_equal(0, rem_ret, "test_arena_remove_and_insert1");
+    remove_node(&list, list.head);
+    insert_front(&list, make_node("zzzz"));
+    assert_node_ptr_equal(NULL, find(&list, "ABC4"),
+                          "test_arena_remove_and_insert2");
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Every constructor fills in the cached length and hash
+void test_node_key_cached()
+{
+    NodePool pool;
+    node_pool_init(&pool);
+    Node *nodes[] = {
+        make_node("zzzz"), make_node_inline("zzzz"),
+        node_pool_make_node(&pool, "zzzz")
+    };
+    int ok = 1;
+    int i;
+    for (i = 0; i < 3; ++i) {
+        ok &= nodes[i]->len == 4;
+        ok &= nodes[i]->hash == hash_bytes("zzzz", 4);
+    }
+    List list;
+    init_list_arena(&list, TEST_DATA, DATA_LEN);
+    ok &= list.last->len == 4 && list.last->hash == hash_bytes("ABC9", 4);
+    assert_int_equal(1, ok, "test_node_key_cached");
+    dealloc_list(&list);
+    free(nodes[0]->data);
+    free(nodes[0]);
+    free(nodes[1]);
+    free(nodes[2]->data);
+    node_pool_dealloc(&pool);
+}
+
+// Strings that are prefixes of each other are told apart by their length
+void test_find_prefix_key()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    insert_front(&list, make_node("ABC"));
+    assert_node_ptr_equal(list.head, find(&list, "ABC"),
+                          "test_find_prefix_key1");
+    assert_node_ptr_equal(NULL, find(&list, "ABC10"), "test_find_prefix_key2");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Every comparison kernel agrees with memcmp for all lengths and mismatch
+// positions up to a few vector widths
+void test_bytes_equal_kernels()
+{
+    BytesEqualFn kernels[3] = { bytes_equal_scalar };
+    int count = 1;
+#ifdef LIST_LIB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        kernels[count++] = bytes_equal_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        kernels[count++] = bytes_equal_avx2;
+#endif
+    char a[100], b[100];
+    memset(a, 'x', sizeof(a));
+    int ok = 1;
+    int k;
+    size_t len, pos;
+    for (k = 0; k < count; ++k) {
+        for (len = 0; len <= sizeof(a); ++len) {
+            memcpy(b, a, sizeof(b));
+            ok &= kernels[k](a, b, len);
+            for (pos = 0; pos < len; ++pos) {
+                b[pos] = 'y';
+                ok &= !kernels[k](a, b, len);
+                b[pos] = 'x';
+            }
+        }
+    }
+    assert_int_equal(1, ok, "test_bytes_equal_kernels");
+}
+
+// Prefix scan returns matches in list order and respects 'max'
+void test_find_prefix()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    insert_after(&list, list.head, make_node("AB"));
+    insert_end(&list, make_node("zzzz"));
+    Node *out[DATA_LEN + 2];
+    assert_int_equal(DATA_LEN, find_prefix(&list, "ABC", out, DATA_LEN + 2),
+                     "test_find_prefix1");
+    assert_node_ptr_equal(list.head->next->next, out[1], "test_find_prefix2");
+    assert_int_equal(3, find_prefix(&list, "AB", out, 3), "test_find_prefix3");
+    assert_int_equal(0, find_prefix(&list, "ABCD", out, 3),
+                     "test_find_prefix4");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Print every string of an unrolled list, block by block
+void test_print_ulist(UList *list)
+{
+    UBlock *b = list->head;
+    puts("==== UList start ====");
+    while (b != NULL) {
+        int i;
+        for (i = 0; i < b->count; ++i)
+            puts(b->items[i]);
+        b = b->next;
+    }
+    puts("==== UList end ====");
+}
+
+// Inserting into full blocks splits them without losing order
+void test_ulist_insert_split()
+{
+    const char *data[3 * ULIST_BLOCK_LEN];
+    char bytes[3 * ULIST_BLOCK_LEN][8];
+    int i;
+    for (i = 0; i < 3 * ULIST_BLOCK_LEN; ++i) {
+        snprintf(bytes[i], sizeof(bytes[i]), "s%d", i);
+        data[i] = bytes[i];
+    }
+    UList list;
+    int init_ret = init_ulist(&list, data, 3 * ULIST_BLOCK_LEN);
+    UPos pos = ulist_find(&list, "s20");
+    int ins_ret = ulist_insert_after(&list, pos, "zzzz");
+    ulist_insert_before(&list, ulist_find(&list, "s0"), "yyyy");
+    assert_int_equal(0, ins_ret, "test_ulist_insert_split1");
+    pos = ulist_find(&list, "zzzz");
+    int next = pos.index + 1 < pos.block->count
+               ? strcmp("s21", pos.block->items[pos.index + 1])
+               : strcmp("s21", pos.block->next->items[0]);
+    assert_int_equal(0, next, "test_ulist_insert_split2");
+    assert_int_equal(0, strcmp("yyyy", list.head->items[0]),
+                     "test_ulist_insert_split3");
+    if (init_ret == 0)
+        dealloc_ulist(&list);
+}
+
+// Removing every string frees every block
+void test_ulist_remove_all()
+{
+    UList list;
+    int init_ret = init_ulist(&list, TEST_DATA, DATA_LEN);
+    ulist_insert_front(&list, "zzzz");
+    int rem_ret = ulist_remove(&list, ulist_find(&list, "ABC4"));
+    assert_int_equal(0, rem_ret, "test_ulist_remove_all1");
+    assert_int_equal(1, ulist_find(&list, "ABC4").block == NULL,
+                     "test_ulist_remove_all2");
+    test_print_ulist(&list);
+    while (list.head != NULL) {
+        UPos head = { list.head, 0 };
+        ulist_remove(&list, head);
+    }
+    assert_int_equal(1, list.last == NULL, "test_ulist_remove_all3");
+    if (init_ret == 0)
+        dealloc_ulist(&list);
+}
+
+// Print every string of a compact list in list order
+void test_print_clist(CList *list)
+{
+    uint32_t i = list->head;
+    puts("==== CList start ====");
+    while (i != CLIST_NIL) {
+        puts(list->nodes[i].data);
+        i = list->nodes[i].next;
+    }
+    puts("==== CList end ====");
+}
+
+// Removed slots are reused by the next insert
+void test_clist_insert_remove()
+{
+    CList list;
+    int init_ret = init_clist(&list, TEST_DATA, DATA_LEN);
+    uint32_t mid = clist_find(&list, "ABC4");
+    assert_int_equal(4, mid, "test_clist_insert_remove1");
+    int rem_ret = clist_remove(&list, mid);
+    assert_int_equal(0, rem_ret, "test_clist_insert_remove2");
+    uint32_t ins = clist_insert_before(&list, list.head, "zzzz");
+    assert_int_equal(mid, ins, "test_clist_insert_remove3");
+    clist_insert_after(&list, list.last, "yyyy");
+    assert_int_equal(INDEX_INVALID, clist_remove(&list, 1000),
+                     "test_clist_insert_remove4");
+    test_print_clist(&list);
+    if (init_ret == 0)
+        dealloc_clist(&list);
+}
+
+// Compaction lays the nodes out in list order
+void test_clist_compact()
+{
+    CList list;
+    int init_ret = init_clist(&list, TEST_DATA, DATA_LEN);
+    clist_remove(&list, clist_find(&list, "ABC0"));
+    clist_insert_end(&list, "zzzz");
+    clist_insert_front(&list, "yyyy");
+    int cmp_ret = clist_compact(&list);
+    assert_int_equal(0, cmp_ret, "test_clist_compact1");
+    assert_int_equal(0, strcmp("yyyy", list.nodes[0].data),
+                     "test_clist_compact2");
+    assert_int_equal(DATA_LEN, clist_find(&list, "zzzz"),
+                     "test_clist_compact3");
+    if (init_ret == 0)
+        dealloc_clist(&list);
+}
+
+// The length follows every kind of insert and remove
+void test_list_length()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    assert_int_equal(DATA_LEN, list_length(&list), "test_list_length1");
+    insert_front(&list, make_node("zzzz"));
+    insert_after(&list, list.head, make_node("yyyy"));
+    remove_node(&list, list.last);
+    assert_int_equal(DATA_LEN + 1, list_length(&list), "test_list_length2");
+    if (init_ret == 0)
+        dealloc_list(&list);
+    init_ret = init_list_arena(&list, TEST_DATA, DATA_LEN);
+    assert_int_equal(DATA_LEN, list_length(&list), "test_list_length3");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Positional access without a skip index
+void test_list_at_walk()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    assert_node_ptr_equal(list.head, list_at(&list, 0), "test_list_at_walk1");
+    assert_node_ptr_equal(find(&list, "ABC7"), list_at(&list, 7),
+                          "test_list_at_walk2");
+    assert_node_ptr_equal(NULL, list_at(&list, DATA_LEN),
+                          "test_list_at_walk3");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// insert_at keeps the skip index in step with the chain, and other
+// mutations are picked up by a rebuild
+void test_skip_insert_at()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, 0);
+    list_skip_attach(&list);
+    char buf[16];
+    uint64_t seed = 12345;
+    int i;
+    for (i = 0; i < 2000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        snprintf(buf, sizeof(buf), "n%d", i);
+        insert_at(&list, (seed >> 33) % (list.size + 1), make_node(buf));
+    }
+    assert_int_equal(0, list.skip->stale, "test_skip_insert_at1");
+    int ok = 1;
+    size_t pos = 0;
+    Node *n;
+    for (n = list.head; n != NULL; n = n->next, ++pos)
+        ok &= list_at(&list, pos) == n;
+    assert_int_equal(1, ok, "test_skip_insert_at2");
+    remove_node(&list, list.head->next);
+    insert_end(&list, make_node("zzzz"));
+    for (n = list.head, pos = 0; n != NULL; n = n->next, ++pos)
+        ok &= list_at(&list, pos) == n;
+    assert_int_equal(1, ok, "test_skip_insert_at3");
+    assert_int_equal(2000, pos, "test_skip_insert_at4");
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// remove_at keeps the skip index in step; other removals leave it stale
+// and positional accesses walk until a rebuild pays off
+void test_skip_remove_at()
+{
+    List list;
+    init_empty_list(&list);
+    list_skip_attach(&list);
+    char buf[16];
+    uint64_t seed = 54321;
+    int i;
+    for (i = 0; i < 2000; ++i) {
+        snprintf(buf, sizeof(buf), "n%d", i);
+        insert_at(&list, list.size, make_node(buf));
+    }
+    for (i = 0; i < 500; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        remove_at(&list, (seed >> 33) % list.size);
+    }
+    assert_int_equal(1, list.size == 1500 && !list.skip->stale,
+                     "test_skip_remove_at1");
+    int ok = 1;
+    size_t pos = 0;
+    Node *n;
+    for (n = list.head; n != NULL; n = n->next, ++pos)
+        ok &= list_at(&list, pos) == n;
+    assert_int_equal(1, ok, "test_skip_remove_at2");
+    remove_node(&list, list.head);
+    ok = list_at(&list, 3) == list.head->next->next->next;
+    assert_int_equal(1, ok && list.skip->stale, "test_skip_remove_at3");
+    for (n = list.head, pos = 0; n != NULL; n = n->next, ++pos)
+        ok &= list_at(&list, pos) == n;
+    assert_int_equal(1, ok && !list.skip->stale, "test_skip_remove_at4");
+    dealloc_list(&list);
+}
+
+// Compare nodes by their first character only, to expose stability
+int compare_first_char(const Node *a, const Node *b, void *ctx)
+{
+    (void)ctx;
+    return (unsigned char)a->data[0] - (unsigned char)b->data[0];
+}
+
+// Whether 'list' is consistently linked in both directions and ordered by
+// 'cmp'
+int list_is_sorted(const List *list, NodeCompare cmp)
+{
+    const Node *i;
+    for (i = list->head; i != NULL; i = i->next) {
+        if (i->next != NULL && (i->next->prev != i || cmp(i, i->next, NULL) > 0))
+            return 0;
+        if (i->next == NULL && list->last != i)
+            return 0;
+    }
+    return list->head == NULL || list->head->prev == NULL;
+}
+
+// Sorting relinks nodes and keeps equal elements in their original order
+void test_sort_list_stable()
+{
+    const char *data[] = { "d1", "b1", "c1", "a1", "b2", "a2", "d2", "c2" };
+    List list;
+    int init_ret = init_list(&list, data, 8);
+    Node *b1 = find(&list, "b1");
+    int sort_ret = sort_list(&list, compare_first_char, NULL);
+    assert_int_equal(0, sort_ret, "test_sort_list_stable1");
+    assert_int_equal(1, list_is_sorted(&list, compare_first_char),
+                     "test_sort_list_stable2");
+    assert_node_ptr_equal(b1, list.head->next->next,
+                          "test_sort_list_stable3");
+    assert_int_equal(0, strcmp("b2", list.head->next->next->next->data),
+                     "test_sort_list_stable4");
+    test_print_list(&list);
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// The parallel sort produces exactly the sequential result
+void test_sort_list_parallel()
+{
+    const int n = 5000;
+    char (*bytes)[8] = malloc(n * sizeof(*bytes));
+    const char **data = malloc(n * sizeof(*data));
+    uint64_t seed = 42;
+    int i;
+    for (i = 0; i < n; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        snprintf(bytes[i], sizeof(bytes[i]), "%c%d",
+                 'a' + (int)(seed >> 60), i);
+        data[i] = bytes[i];
+    }
+    List seq, par;
+    init_list(&seq, data, n);
+    init_list(&par, data, n);
+    WorkerPool pool;
+    worker_pool_init(&pool, 3);
+    sort_list(&seq, compare_first_char, NULL);
+    int sort_ret = sort_list_parallel(&par, compare_first_char, NULL, &pool);
+    worker_pool_dealloc(&pool);
+    assert_int_equal(0, sort_ret, "test_sort_list_parallel1");
+    int same = list_is_sorted(&par, compare_first_char);
+    Node *a, *b;
+    for (a = seq.head, b = par.head; a != NULL && b != NULL;
+         a = a->next, b = b->next)
+        same &= strcmp(a->data, b->data) == 0;
+    assert_int_equal(1, same && a == NULL && b == NULL,
+                     "test_sort_list_parallel2");
+    dealloc_list(&seq);
+    dealloc_list(&par);
+    free(data);
+    free(bytes);
+}
+
+void copy_node_data(const Node *node, void *ctx)
+{
+    strcpy(ctx, node->data);
+}
+
+// Single-threaded behaviour of the reader-writer list wrapper
+void test_rwlist_basic()
+{
+    RwList list;
+    int init_ret = init_rwlist(&list, TEST_DATA, DATA_LEN);
+    assert_int_equal(0, init_ret, "test_rwlist_basic1");
+    rwlist_insert_after(&list, "ABC4", "zzzz");
+    rwlist_insert_front(&list, "yyyy");
+    assert_int_equal(0, rwlist_remove(&list, "ABC9"), "test_rwlist_basic2");
+    assert_int_equal(NOT_FOUND, rwlist_remove(&list, "ABC9"),
+                     "test_rwlist_basic3");
+    assert_int_equal(1, rwlist_contains(&list, "zzzz"), "test_rwlist_basic4");
+    char buf[8] = "";
+    rwlist_find_apply(&list, "yyyy", copy_node_data, buf);
+    assert_int_equal(0, strcmp("yyyy", buf), "test_rwlist_basic5");
+    assert_node_ptr_equal(find(&list.list, "ABC4")->next,
+                          find(&list.list, "zzzz"), "test_rwlist_basic6");
+    test_print_list(&list.list);
+    if (init_ret == 0)
+        dealloc_rwlist(&list);
+}
+
+void *rwlist_hammer(void *arg)
+{
+    RwList *list = arg;
+    char buf[16];
+    int i;
+    for (i = 0; i < 2000; ++i) {
+        snprintf(buf, sizeof(buf), "t%d", i % 50);
+        if (i % 4 == 0) {
+            rwlist_insert_end(list, buf);
+            rwlist_remove(list, buf);
+        } else {
+            rwlist_contains(list, "ABC9");
+        }
+    }
+    return NULL;
+}
+
+// Concurrent readers and writers leave the list intact
+void test_rwlist_threads()
+{
+    RwList list;
+    int init_ret = init_rwlist(&list, TEST_DATA, DATA_LEN);
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; ++i)
+        pthread_create(&threads[i], NULL, rwlist_hammer, &list);
+    for (i = 0; i < 4; ++i)
+        pthread_join(threads[i], NULL);
+    assert_int_equal(DATA_LEN, list_length(&list.list),
+                     "test_rwlist_threads");
+    if (init_ret == 0)
+        dealloc_rwlist(&list);
+}
+
+// Whether 'list' is strictly ascending with no deleted nodes left behind.
+// Returns the node count, or -1 if not.
+int lflist_check(const LfList *list)
+{
+    int count = 0;
+    const LfNode *n;
+    for (n = lf_ptr(list->head); n != NULL; n = lf_ptr(n->next), ++count) {
+        if ((n->next & LF_MARK)
+            || (lf_ptr(n->next) && strcmp(n->data, lf_ptr(n->next)->data) >= 0))
+            return -1;
+    }
+    return count;
+}
+
+// Single-threaded semantics of the lock-free list
+void test_lflist_basic()
+{
+    LfList list;
+    init_lflist(&list);
+    LfThread *t = lflist_thread_register(&list);
+    int i;
+    for (i = DATA_LEN - 1; i >= 0; --i)
+        lflist_insert(&list, t, TEST_DATA[i]);
+    assert_int_equal(DUPLICATE, lflist_insert(&list, t, "ABC3"),
+                     "test_lflist_basic1");
+    assert_int_equal(0, lflist_remove(&list, t, "ABC3"), "test_lflist_basic2");
+    assert_int_equal(NOT_FOUND, lflist_remove(&list, t, "ABC3"),
+                     "test_lflist_basic3");
+    assert_int_equal(1, lflist_contains(&list, t, "ABC9"),
+                     "test_lflist_basic4");
+    assert_int_equal(0, lflist_contains(&list, t, "ABC3"),
+                     "test_lflist_basic5");
+    assert_int_equal(DATA_LEN - 1, lflist_check(&list), "test_lflist_basic6");
+    assert_int_equal(0, strcmp("ABC0", lf_ptr(list.head)->data),
+                     "test_lflist_basic7");
+    lflist_thread_unregister(&list, t);
+    dealloc_lflist(&list);
+}
+
+LfNode *lf_test_node(const char *data)
+{
+    LfNode *node = malloc(sizeof(*node) + strlen(data) + 1);
+    strcpy(node->data, data);
+    node->next = 0;
+    return node;
+}
+
+// The path lf_retire takes when its retired array can't grow: deferred
+// nodes never block, stay while anyone (the retiring thread included)
+// holds them, and are freed by the first scan after that
+void test_lflist_retire_deferred()
+{
+    LfList list;
+    init_lflist(&list);
+    LfThread *t = lflist_thread_register(&list);
+    LfThread *reader = lflist_thread_register(&list);
+    LfNode *own = lf_test_node("ABC0");
+    LfNode *held = lf_test_node("ABC1");
+    LfNode *idle = lf_test_node("ABC2");
+    lf_protect(t, 0, own);
+    lf_protect(reader, 0, held);
+    lf_defer(t, own);
+    lf_defer(t, held);
+    lf_defer(t, idle);
+    lf_scan(&list, t);
+    int kept = 0;
+    int marked = 1;
+    LfNode *n;
+    for (n = t->deferred; n != NULL; n = lf_ptr(n->next)) {
+        kept += n == own || n == held;
+        marked &= (n->next & LF_MARK) != 0;
+    }
+    assert_int_equal(1, kept == 2 && marked, "test_lflist_retire_deferred1");
+    lf_clear_hazards(t);
+    lf_clear_hazards(reader);
+    lf_scan(&list, t);
+    assert_int_equal(1, t->deferred == NULL, "test_lflist_retire_deferred2");
+    lflist_thread_unregister(&list, reader);
+    lflist_thread_unregister(&list, t);
+    dealloc_lflist(&list);
+}
+
+typedef struct {
+    LfList *list;
+    int id;
+    int net; // successful inserts minus successful removes
+} LfStress;
+
+void *lflist_stress_thread(void *arg)
+{
+    LfStress *s = arg;
+    LfThread *t = lflist_thread_register(s->list);
+    uint64_t seed = 0x9E3779B97F4A7C15ull * (s->id + 1);
+    char buf[16];
+    int i;
+    for (i = 0; i < 20000; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        snprintf(buf, sizeof(buf), "k%03d", (int)(seed % 64));
+        switch ((seed >> 32) % 3) {
+        case 0:
+            s->net += lflist_insert(s->list, t, buf) == 0;
+            break;
+        case 1:
+            s->net -= lflist_remove(s->list, t, buf) == 0;
+            break;
+        default:
+            lflist_contains(s->list, t, buf);
+        }
+    }
+    lflist_thread_unregister(s->list, t);
+    return NULL;
+}
+
+// Threads inserting and removing overlapping keys agree on the final size
+void test_lflist_stress()
+{
+    LfList list;
+    init_lflist(&list);
+    LfStress stress[4];
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; ++i) {
+        stress[i].list = &list;
+        stress[i].id = i;
+        stress[i].net = 0;
+        pthread_create(&threads[i], NULL, lflist_stress_thread, &stress[i]);
+    }
+    int net = 0;
+    for (i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+        net += stress[i].net;
+    }
+    assert_int_equal(net, lflist_check(&list), "test_lflist_stress");
+    dealloc_lflist(&list);
+}
+
+typedef struct {
+    EpochDomain *domain;
+    int stop;
+    int misses; // lookups of always-present strings that failed
+} EpochTest;
+
+void *epoch_reader_thread(void *arg)
+{
+    EpochTest *e = arg;
+    EpochThread *t = epoch_thread_register(e->domain);
+    while (!__atomic_load_n(&e->stop, __ATOMIC_ACQUIRE)) {
+        epoch_enter(t);
+        Node *n = find_concurrent(e->domain->list, "ABC9");
+        if (n == NULL || strcmp(n->data, "ABC9") != 0)
+            ++e->misses;
+        find_concurrent(e->domain->list, "zzzz");
+        epoch_exit(t);
+    }
+    epoch_thread_unregister(t);
+    return NULL;
+}
+
+// Readers walking the list while a writer removes nodes under them never
+// touch freed memory (run under a sanitizer) and never lose other nodes
+void test_epoch_concurrent_remove()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    EpochDomain domain;
+    init_epoch_domain(&domain, &list);
+    EpochTest e = { &domain, 0, 0 };
+    pthread_t readers[2];
+    int i;
+    for (i = 0; i < 2; ++i)
+        pthread_create(&readers[i], NULL, epoch_reader_thread, &e);
+
+    EpochThread *w = epoch_thread_register(&domain);
+    for (i = 0; i < 20000; ++i) {
+        insert_front(&list, make_node("zzzz"));
+        remove_node_deferred(w, list.head);
+    }
+    epoch_reclaim(w);
+    epoch_thread_unregister(w);
+    __atomic_store_n(&e.stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < 2; ++i)
+        pthread_join(readers[i], NULL);
+
+    assert_int_equal(0, e.misses, "test_epoch_concurrent_remove1");
+    assert_int_equal(DATA_LEN, list_length(&list),
+                     "test_epoch_concurrent_remove2");
+    dealloc_epoch_domain(&domain);
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+typedef struct {
+    RcuDomain *domain;
+    int stop;
+    int misses; // lookups of always-present strings that failed
+} RcuTest;
+
+void *rcu_reader_thread(void *arg)
+{
+    RcuTest *r = arg;
+    RcuThread *t = rcu_thread_register(r->domain);
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        Node *n = find_concurrent(r->domain->list, "ABC9");
+        if (n == NULL || strcmp(n->data, "ABC9") != 0)
+            ++r->misses;
+        find_concurrent(r->domain->list, "zzzz");
+        rcu_quiescent(r->domain, t);
+    }
+    rcu_thread_unregister(t);
+    return NULL;
+}
+
+// Readers walking the list with no synchronization survive a writer that
+// removes nodes under them
+void test_rcu_concurrent_remove()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    RcuDomain domain;
+    init_rcu_domain(&domain, &list);
+    RcuTest r = { &domain, 0, 0 };
+    pthread_t readers[2];
+    int i;
+    for (i = 0; i < 2; ++i)
+        pthread_create(&readers[i], NULL, rcu_reader_thread, &r);
+
+    for (i = 0; i < 5000; ++i) {
+        rcu_write_lock(&domain);
+        insert_front(&list, make_node("zzzz"));
+        remove_node_rcu(&domain, list.head);
+        rcu_write_unlock(&domain);
+        if (rcu_reclaim_due(&domain))
+            rcu_reclaim(&domain);
+    }
+    rcu_reclaim(&domain);
+    __atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < 2; ++i)
+        pthread_join(readers[i], NULL);
+
+    assert_int_equal(0, r.misses, "test_rcu_concurrent_remove1");
+    assert_int_equal(0, domain.deferred_count, "test_rcu_concurrent_remove2");
+    dealloc_rcu_domain(&domain);
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Offline readers don't hold up grace periods
+void test_rcu_offline_reader()
+{
+    List list;
+    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
+    RcuDomain domain;
+    init_rcu_domain(&domain, &list);
+    RcuThread *t = rcu_thread_register(&domain);
+    rcu_thread_offline(t);
+    rcu_write_lock(&domain);
+    remove_node_rcu(&domain, list.head);
+    rcu_write_unlock(&domain);
+    rcu_reclaim(&domain);
+    rcu_thread_online(&domain, t);
+    assert_int_equal(DATA_LEN - 1, list_length(&list),
+                     "test_rcu_offline_reader");
+    rcu_thread_unregister(t);
+    dealloc_rcu_domain(&domain);
+    if (init_ret == 0)
+        dealloc_list(&list);
+}
+
+// Strings land in their hash shard and come back out in insertion order,
+// or sorted without the shards being reordered
+void test_sharded_list()
+{
+    ShardedList list;
+    int init_ret = init_sharded_list(&list, 4);
+    int i;
+    for (i = DATA_LEN - 1; i >= 0; --i)
+        sharded_insert(&list, TEST_DATA[i]);
+    assert_int_equal(DATA_LEN, sharded_length(&list), "test_sharded_list1");
+    assert_int_equal(1, sharded_contains(&list, "ABC4"), "test_sharded_list2");
+    assert_int_equal(0, sharded_remove(&list, "ABC4"), "test_sharded_list3");
+    assert_int_equal(0, sharded_contains(&list, "ABC4"), "test_sharded_list4");
+    ShardedIter it;
+    sharded_iter_begin(&it, &list, NULL, NULL);
+    int ordered = 1;
+    int count = 0;
+    i = DATA_LEN - 1;
+    Node *n;
+    while ((n = sharded_iter_next(&it)) != NULL) {
+        if (i == 4)
+            --i;
+        ordered &= strcmp(n->data, TEST_DATA[i--]) == 0;
+        ++count;
+    }
+    sharded_iter_end(&it);
+    assert_int_equal(1, ordered && count == DATA_LEN - 1,
+                     "test_sharded_list5");
+    Node *heads[4];
+    size_t s;
+    for (s = 0; s < 4; ++s)
+        heads[s] = list.shards[s].list.head;
+    sharded_iter_begin(&it, &list, node_compare_data, NULL);
+    ordered = 1;
+    count = 0;
+    Node *prev = NULL;
+    while ((n = sharded_iter_next(&it)) != NULL) {
+        ordered &= prev == NULL || strcmp(prev->data, n->data) < 0;
+        prev = n;
+        ++count;
+    }
+    sharded_iter_end(&it);
+    int untouched = 1;
+    for (s = 0; s < 4; ++s)
+        untouched &= heads[s] == list.shards[s].list.head;
+    assert_int_equal(1, ordered && untouched && count == DATA_LEN - 1,
+                     "test_sharded_list6");
+    if (init_ret == 0)
+        dealloc_sharded_list(&list);
+}
+
+// Strings come out of the queue in the order they went in, singly or in
+// batches, and the emptied nodes are kept for reuse
+void test_work_queue_fifo()
+{
+    WorkQueue q;
+    init_work_queue(&q);
+    int i;
+    for (i = 0; i < DATA_LEN; ++i)
+        wq_push(&q, TEST_DATA[i]);
+    char *s = wq_try_pop(&q);
+    int ordered = s != NULL && strcmp(s, TEST_DATA[0]) == 0;
+    free(s);
+    char *batch[DATA_LEN];
+    size_t count = wq_pop_batch(&q, batch, DATA_LEN, 0);
+    for (i = 0; i < (int)count; ++i) {
+        ordered &= strcmp(batch[i], TEST_DATA[i + 1]) == 0;
+        free(batch[i]);
+    }
+    assert_int_equal(1, ordered && (int)count == DATA_LEN - 1,
+                     "test_work_queue_fifo1");
+    assert_int_equal(1, wq_try_pop(&q) == NULL, "test_work_queue_fifo2");
+    assert_int_equal(DATA_LEN, (int)q.free_count, "test_work_queue_fifo3");
+    wq_push(&q, "ABC");
+    wq_close(&q);
+    s = wq_pop(&q);
+    assert_int_equal(1, s != NULL && strcmp(s, "ABC") == 0,
+                     "test_work_queue_fifo4");
+    free(s);
+    assert_int_equal(1, wq_pop(&q) == NULL, "test_work_queue_fifo5");
+    dealloc_work_queue(&q);
+}
+
+#define WQ_TEST_ITEMS 20000
+
+typedef struct {
+    WorkQueue q;
+    int next_producer;
+    long popped;
+    long sum;
+} WqTest;
+
+void *wq_producer_thread(void *arg)
+{
+    WqTest *t = arg;
+    int id = __atomic_fetch_add(&t->next_producer, 1, __ATOMIC_RELAXED);
+    char buf[16];
+    int i;
+    for (i = 0; i < WQ_TEST_ITEMS; ++i) {
+        snprintf(buf, sizeof(buf), "%d", id * WQ_TEST_ITEMS + i);
+        wq_push(&t->q, buf);
+    }
+    return NULL;
+}
+
+void *wq_consumer_thread(void *arg)
+{
+    WqTest *t = arg;
+    char *batch[8];
+    size_t count;
+    while ((count = wq_pop_batch(&t->q, batch, 8, 1)) > 0) {
+        size_t i;
+        for (i = 0; i < count; ++i) {
+            __atomic_add_fetch(&t->sum, atol(batch[i]), __ATOMIC_RELAXED);
+            free(batch[i]);
+        }
+        __atomic_add_fetch(&t->popped, (long)count, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Two producers and two blocked consumers hand over every item exactly once
+void test_work_queue_threads()
+{
+    WqTest t;
+    init_work_queue(&t.q);
+    t.next_producer = 0;
+    t.popped = 0;
+    t.sum = 0;
+    pthread_t producers[2], consumers[2];
+    int i;
+    for (i = 0; i < 2; ++i)
+        pthread_create(&consumers[i], NULL, wq_consumer_thread, &t);
+    for (i = 0; i < 2; ++i)
+        pthread_create(&producers[i], NULL, wq_producer_thread, &t);
+    for (i = 0; i < 2; ++i)
+        pthread_join(producers[i], NULL);
+    wq_close(&t.q);
+    for (i = 0; i < 2; ++i)
+        pthread_join(consumers[i], NULL);
+    long n = 2L * WQ_TEST_ITEMS;
+    assert_int_equal(1, t.popped == n && t.sum == n * (n - 1) / 2,
+                     "test_work_queue_threads");
+    dealloc_work_queue(&t.q);
+}
+
+// Inserts land next to their key and removal relinks both directions
+void test_hlist_basic()
+{
+    HList list;
+    init_hlist(&list);
+    int i;
+    for (i = DATA_LEN - 1; i >= 0; --i)
+        hlist_insert_front(&list, TEST_DATA[i]);
+    hlist_insert_after(&list, "ABC3", "after");
+    hlist_insert_before(&list, "ABC3", "before");
+    assert_int_equal(NOT_FOUND, hlist_insert_after(&list, "zzzz", "x"),
+                     "test_hlist_basic1");
+    HNode *n = list.head.next;
+    for (i = 0; i < 3; ++i)
+        n = n->next;
+    int linked = strcmp(n->data, "before") == 0
+        && strcmp(n->next->data, "ABC3") == 0
+        && strcmp(n->next->next->data, "after") == 0
+        && n->next->prev == n;
+    assert_int_equal(1, linked, "test_hlist_basic2");
+    assert_int_equal(0, hlist_remove(&list, "ABC3"), "test_hlist_basic3");
+    assert_int_equal(1, n->next->prev == n && !hlist_contains(&list, "ABC3"),
+                     "test_hlist_basic4");
+    assert_int_equal(DATA_LEN + 1, hlist_length(&list), "test_hlist_basic5");
+    dealloc_hlist(&list);
+}
+
+typedef struct {
+    HList list;
+    int next_thread;
+} HListTest;
+
+void *hlist_writer_thread(void *arg)
+{
+    HListTest *t = arg;
+    int id = __atomic_fetch_add(&t->next_thread, 1, __ATOMIC_RELAXED);
+    char key[16];
+    snprintf(key, sizeof(key), "w%d", id);
+    const char *anchor = TEST_DATA[id * 3 % DATA_LEN];
+    int i;
+    for (i = 0; i < 2000; ++i) {
+        if (i % 2)
+            hlist_insert_after(&t->list, anchor, key);
+        else
+            hlist_insert_before(&t->list, anchor, key);
+        hlist_remove(&t->list, key);
+    }
+    return NULL;
+}
+
+// Writers inserting and removing around different anchors leave the list
+// as it started, with consistent back links
+void test_hlist_threads()
+{
+    HListTest t;
+    init_hlist(&t.list);
+    t.next_thread = 0;
+    int i;
+    for (i = DATA_LEN - 1; i >= 0; --i)
+        hlist_insert_front(&t.list, TEST_DATA[i]);
+    pthread_t threads[3];
+    for (i = 0; i < 3; ++i)
+        pthread_create(&threads[i], NULL, hlist_writer_thread, &t);
+    for (i = 0; i < 3; ++i)
+        pthread_join(threads[i], NULL);
+    int ok = hlist_length(&t.list) == DATA_LEN;
+    HNode *n;
+    i = 0;
+    for (n = t.list.head.next; n != &t.list.tail; n = n->next)
+        ok &= n->next->prev == n && strcmp(n->data, TEST_DATA[i++]) == 0;
+    assert_int_equal(1, ok, "test_hlist_threads");
+    dealloc_hlist(&t.list);
+}
+
+// find_parallel returns the same node as find, duplicates included, before
+// and after the checkpoints go stale
+void test_find_parallel()
+{
+    const int n = 2000;
+    char (*bytes)[8] = malloc(n * sizeof(*bytes));
+    const char **data = malloc(n * sizeof(*data));
+    int i;
+    for (i = 0; i < n; ++i) {
+        snprintf(bytes[i], sizeof(bytes[i]), "k%d", i * 7 % 300);
+        data[i] = bytes[i];
+    }
     List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    if (init_ret == 0)
+    init_list(&list, data, n);
+    list_checkpoints_attach(&list, 16);
+    WorkerPool pool;
+    worker_pool_init(&pool, 3);
+    int same = find_parallel(&list, "missing", &pool) == NULL;
+    for (i = 0; i < n; i += 37)
+        same &= find_parallel(&list, data[i], &pool) == find(&list, data[i]);
+    assert_int_equal(1, same, "test_find_parallel1");
+
+    Node *cp = list.checkpoints->nodes[2];
+    remove_node(&list, cp);
+    assert_int_equal(1, list.checkpoints->stale, "test_find_parallel2");
+    insert_front(&list, make_node(data[n - 1]));
+    same = 1;
+    for (i = 0; i < n; i += 37)
+        same &= find_parallel(&list, data[i], &pool) == find(&list, data[i]);
+    assert_int_equal(1, same && !list.checkpoints->stale,
+                     "test_find_parallel3");
+    worker_pool_dealloc(&pool);
+    dealloc_list(&list);
+    free(data);
+    free(bytes);
+}
+
+void count_node_bytes(const Node *node, void *ctx)
+{
+    __atomic_add_fetch((size_t *)ctx, node->len, __ATOMIC_RELAXED);
+}
+
+// Counts nodes that 'ctx' (a List with a hash index) can't find by their
+// own contents
+typedef struct {
+    List *list;
+    int misses;
+} IndexedVisit;
+
+void check_indexed_node(const Node *node, void *ctx)
+{
+    IndexedVisit *v = ctx;
+    if (find(v->list, node->data) == NULL)
+        __atomic_add_fetch(&v->misses, 1, __ATOMIC_RELAXED);
+}
+
+char *bracket_node(const Node *node, void *ctx)
+{
+    (void)ctx;
+    char *out = malloc(node->len + 3);
+    if (out != NULL)
+        sprintf(out, "[%s]", node->data);
+    return out;
+}
+
+// Every node is visited once, sequentially and on the pool, and a walk
+// leaves an attached hash index usable
+void test_list_for_each()
+{
+    const int n = 1000;
+    const char **keys = malloc(n * sizeof(*keys));
+    char (*bytes)[8] = malloc(n * sizeof(*bytes));
+    int i;
+    size_t expected = 0;
+    for (i = 0; i < n; ++i) {
+        snprintf(bytes[i], sizeof(bytes[i]), "k%d", i);
+        keys[i] = bytes[i];
+        expected += strlen(bytes[i]);
+    }
+    List list;
+    init_list(&list, keys, n);
+    WorkerPool pool;
+    worker_pool_init(&pool, 3);
+    size_t total = 0;
+    list_for_each(&list, count_node_bytes, &total);
+    assert_int_equal(1, total == expected, "test_list_for_each1");
+    total = 0;
+    list_for_each_parallel(&list, count_node_bytes, &total, &pool);
+    assert_int_equal(1, total == expected, "test_list_for_each2");
+    list_index_attach(&list);
+    IndexedVisit v = { &list, 0 };
+    list_for_each_parallel(&list, check_indexed_node, &v, &pool);
+    int found = v.misses == 0 && find(&list, "k999") != NULL
+        && find(&list, "K999") == NULL;
+    assert_int_equal(1, found, "test_list_for_each3");
+    worker_pool_dealloc(&pool);
+    dealloc_list(&list);
+    free(keys);
+    free(bytes);
+}
+
+// Mapped lists keep source order and agree between the two modes
+void test_list_map()
+{
+    const int n = 1000;
+    const char **keys = malloc(n * sizeof(*keys));
+    char (*bytes)[8] = malloc(n * sizeof(*bytes));
+    int i;
+    for (i = 0; i < n; ++i) {
+        snprintf(bytes[i], sizeof(bytes[i]), "k%d", i);
+        keys[i] = bytes[i];
+    }
+    List src, seq, par;
+    init_list(&src, keys, n);
+    WorkerPool pool;
+    worker_pool_init(&pool, 3);
+    list_map(&src, &seq, bracket_node, NULL);
+    int ret = list_map_parallel(&src, &par, bracket_node, NULL, &pool);
+    assert_int_equal(0, ret, "test_list_map1");
+    int same = seq.size == (size_t)n && par.size == (size_t)n
+        && strcmp(par.head->data, "[k0]") == 0
+        && strcmp(par.last->data, "[k999]") == 0;
+    Node *a, *b;
+    for (a = seq.head, b = par.head; a != NULL && b != NULL;
+         a = a->next, b = b->next)
+        same &= strcmp(a->data, b->data) == 0 && (b->next == NULL
+                                                  || b->next->prev == b);
+    assert_int_equal(1, same && a == NULL && b == NULL, "test_list_map2");
+    worker_pool_dealloc(&pool);
+    dealloc_list(&src);
+    dealloc_list(&seq);
+    dealloc_list(&par);
+    free(keys);
+    free(bytes);
+}
+
+// Released blocks are reused by the same thread, and overflow reaches other
+// threads through the depot
+void test_node_cache_reuse()
+{
+    List list;
+    init_empty_list(&list);
+    Node *a = make_node_cached("ABC");
+    release_node(&list, a);
+    Node *b = make_node_cached("DEF");
+    assert_int_equal(1, a == b && b->kind == NODE_CACHED
+                     && strcmp(b->data, "DEF") == 0,
+                     "test_node_cache_reuse1");
+    release_node(&list, b);
+
+    char big[300];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    Node *heap = make_node_cached(big);
+    assert_int_equal(NODE_HEAP, heap->kind, "test_node_cache_reuse2");
+    release_node(&list, heap);
+
+    int i;
+    for (i = 0; i < 100; ++i)
+        insert_end(&list, make_node_cached(TEST_DATA[i % DATA_LEN]));
+    assert_int_equal(1, find(&list, "ABC7") != NULL, "test_node_cache_reuse3");
+    dealloc_list(&list);
+    node_cache_flush();
+    node_cache_trim();
+}
+
+void *node_cache_thread(void *arg)
+{
+    Node **out = arg;
+    *out = make_node_cached("ABC");
+    return NULL;
+}
+
+// A block freed on one thread can be allocated on another once its batch is
+// in the depot
+void test_node_cache_depot()
+{
+    List list;
+    init_empty_list(&list);
+    Node *nodes[NODE_CACHE_BATCH];
+    int i;
+    for (i = 0; i < NODE_CACHE_BATCH; ++i)
+        nodes[i] = make_node_cached("ABC");
+    for (i = 0; i < NODE_CACHE_BATCH; ++i)
+        release_node(&list, nodes[i]);
+    node_cache_flush();
+    Node *got = NULL;
+    pthread_t t;
+    pthread_create(&t, NULL, node_cache_thread, &got);
+    pthread_join(t, NULL);
+    int reused = 0;
+    for (i = 0; i < NODE_CACHE_BATCH; ++i)
+        reused |= got == nodes[i];
+    assert_int_equal(1, reused, "test_node_cache_depot");
+    release_node(&list, got);
+    node_cache_flush();
+    node_cache_trim();
+}
+
+void *node_cache_release_thread(void *arg)
+{
+    Node **nodes = arg;
+    List list;
+    init_empty_list(&list);
+    int i;
+    for (i = 0; i < NODE_CACHE_BATCH; ++i)
+        release_node(&list, nodes[i]);
+    return NULL;
+}
+
+// A thread that only frees blocks still hands them to the depot when it
+// exits
+void test_node_cache_free_only_thread()
+{
+    node_cache_flush();
+    node_cache_trim();
+    Node *nodes[NODE_CACHE_BATCH];
+    int i;
+    for (i = 0; i < NODE_CACHE_BATCH; ++i)
+        nodes[i] = make_node_cached("ABC");
+    pthread_t t;
+    pthread_create(&t, NULL, node_cache_release_thread, nodes);
+    pthread_join(t, NULL);
+    int c = nodes[0]->size_class;
+    int found = 0;
+    pthread_mutex_lock(&node_depot[c].lock);
+    Node *batch;
+    for (batch = node_depot[c].batches; batch != NULL; batch = batch->prev) {
+        Node *n;
+        for (n = batch; n != NULL; n = n->next) {
+            for (i = 0; i < NODE_CACHE_BATCH; ++i)
+                found += n == nodes[i];
+        }
+    }
+    pthread_mutex_unlock(&node_depot[c].lock);
+    assert_int_equal(NODE_CACHE_BATCH, found,
+                     "test_node_cache_free_only_thread");
+    node_cache_trim();
+}
+
+// Back links, 'last' and 'size' agree with the forward chain, and the
+// contents spell out 'expect'
+int list_matches(const List *list, const char *expect[], size_t count)
+{
+    size_t n = 0;
+    const Node *prev = NULL;
+    const Node *i;
+    for (i = list->head; i != NULL; prev = i, i = i->next, ++n) {
+        if (i->prev != prev || n >= count || strcmp(i->data, expect[n]) != 0)
+            return 0;
+    }
+    return list->last == prev && list->size == count && n == count;
+}
+
+// A range moves between indexed lists and both indexes follow it
+void test_list_splice()
+{
+    List a, b;
+    init_list(&a, TEST_DATA, 5);
+    init_list(&b, TEST_DATA + 5, 5);
+    list_index_attach(&a);
+    list_index_attach(&b);
+    int ret = list_splice(&b, find(&b, "ABC6"), &a, find(&a, "ABC1"),
+                          find(&a, "ABC3"));
+    assert_int_equal(0, ret, "test_list_splice1");
+    const char *expect_a[] = { "ABC0", "ABC4" };
+    const char *expect_b[] = { "ABC5", "ABC1", "ABC2", "ABC3", "ABC6",
+                               "ABC7", "ABC8", "ABC9" };
+    assert_int_equal(1, list_matches(&a, expect_a, 2)
+                     && list_matches(&b, expect_b, 8),
+                     "test_list_splice2");
+    assert_int_equal(1, find(&a, "ABC2") == NULL && find(&b, "ABC2") != NULL,
+                     "test_list_splice3");
+    dealloc_list(&a);
+    dealloc_list(&b);
+}
+
+// Moving a range within one list, and into itself
+void test_list_splice_same_list()
+{
+    List list;
+    init_list(&list, TEST_DATA, 5);
+    Node *first = find(&list, "ABC3");
+    list_splice(&list, list.head, &list, first, list.last);
+    const char *expect[] = { "ABC3", "ABC4", "ABC0", "ABC1", "ABC2" };
+    assert_int_equal(1, list_matches(&list, expect, 5),
+                     "test_list_splice_same_list1");
+    assert_int_equal(INDEX_INVALID,
+                     list_splice(&list, first->next, &list, first, list.last),
+                     "test_list_splice_same_list2");
+    dealloc_list(&list);
+}
+
+// Concatenation empties the source and hands over its arena
+void test_list_concat()
+{
+    List a, b;
+    init_list(&a, TEST_DATA, 3);
+    init_list_arena(&b, TEST_DATA + 3, 2);
+    assert_int_equal(0, list_concat(&a, &b), "test_list_concat1");
+    const char *expect[] = { "ABC0", "ABC1", "ABC2", "ABC3", "ABC4" };
+    assert_int_equal(1, list_matches(&a, expect, 5)
+                     && b.head == NULL && b.size == 0 && b.arena == NULL,
+                     "test_list_concat2");
+    dealloc_list(&b);
+    dealloc_list(&a);
+}
+
+// A counted splice between plain lists relinks in place and keeps sizes,
+// skip indexes and checkpoints usable
+void test_list_splice_n()
+{
+    List a, b;
+    init_list(&a, TEST_DATA, 5);
+    init_list(&b, TEST_DATA + 5, 5);
+    list_skip_attach(&b);
+    list_checkpoints_attach(&a, 2);
+    checkpoints_ready(&a);
+    int ret = list_splice_n(&b, find(&b, "ABC6"), &a, find(&a, "ABC1"),
+                            find(&a, "ABC3"), 3);
+    assert_int_equal(0, ret, "test_list_splice_n1");
+    const char *expect_a[] = { "ABC0", "ABC4" };
+    const char *expect_b[] = { "ABC5", "ABC1", "ABC2", "ABC3", "ABC6",
+                               "ABC7", "ABC8", "ABC9" };
+    assert_int_equal(1, list_matches(&a, expect_a, 2)
+                     && list_matches(&b, expect_b, 8)
+                     && a.checkpoints->stale,
+                     "test_list_splice_n2");
+    Node *at = list_at(&b, 3);
+    assert_int_equal(1, at != NULL && strcmp(at->data, "ABC3") == 0,
+                     "test_list_splice_n3");
+    dealloc_list(&a);
+    dealloc_list(&b);
+}
+
+// Splitting keeps both halves consistent; pool nodes stay with their pool
+void test_list_split_at()
+{
+    List list, rest;
+    init_list(&list, TEST_DATA, DATA_LEN);
+    list_checkpoints_attach(&list, 2);
+    checkpoints_ready(&list);
+    int ret = list_split_at(&list, find(&list, "ABC6"), &rest);
+    assert_int_equal(0, ret, "test_list_split_at1");
+    const char *expect_rest[] = { "ABC6", "ABC7", "ABC8", "ABC9" };
+    assert_int_equal(1, list_matches(&list, TEST_DATA, 6)
+                     && list_matches(&rest, expect_rest, 4)
+                     && list.checkpoints->stale,
+                     "test_list_split_at2");
+    dealloc_list(&rest);
+    dealloc_list(&list);
+
+    NodePool pool;
+    node_pool_init(&pool);
+    init_list_pooled(&list, &pool, TEST_DATA, DATA_LEN);
+    List other;
+    init_empty_list(&other);
+    assert_int_equal(OWNER_MISMATCH,
+                     list_splice(&other, NULL, &list, list.head, list.head),
+                     "test_list_split_at3");
+    dealloc_list(&list);
+    node_pool_dealloc(&pool);
+}
+
+// A batch lands in order at the insertion point and is indexed
+void test_insert_batch_after()
+{
+    List list;
+    init_list(&list, TEST_DATA, 3);
+    list_index_attach(&list);
+    const char *batch[] = { "x0", "x1", "x2" };
+    int ret = insert_batch_after(&list, list.head, batch, 3);
+    assert_int_equal(0, ret, "test_insert_batch_after1");
+    const char *expect[] = { "ABC0", "x0", "x1", "x2", "ABC1", "ABC2" };
+    assert_int_equal(1, list_matches(&list, expect, 6)
+                     && find(&list, "x1") == list.head->next->next,
+                     "test_insert_batch_after2");
+    remove_node(&list, find(&list, "x1"));
+    assert_int_equal(1, find(&list, "x1") == NULL && list.size == 5,
+                     "test_insert_batch_after3");
+    dealloc_list(&list);
+}
+
+void test_insert_batch_end()
+{
+    List list;
+    init_empty_list(&list);
+    insert_batch_end(&list, TEST_DATA, 4);
+    insert_batch_end(&list, TEST_DATA + 4, DATA_LEN - 4);
+    assert_int_equal(1, list_matches(&list, TEST_DATA, DATA_LEN),
+                     "test_insert_batch_end1");
+    assert_int_equal(LEN_INVALID, insert_batch_end(&list, TEST_DATA, -1),
+                     "test_insert_batch_end2");
+    dealloc_list(&list);
+}
+
+// Removing batch nodes gives their block back once the last one goes, so
+// repeated insert and remove doesn't grow the list; the nodes also split
+// and splice like any other
+void test_insert_batch_reclaim()
+{
+    List list;
+    init_list(&list, TEST_DATA, 2);
+    const char *batch[] = { "x0", "x1", "x2" };
+    insert_batch_end(&list, batch, 3);
+    BatchBlock *block = batch_block_of(list.last);
+    remove_node(&list, find(&list, "x1"));
+    assert_int_equal(2, (int)block->live, "test_insert_batch_reclaim1");
+    remove_node(&list, find(&list, "x0"));
+    remove_node(&list, find(&list, "x2"));
+    int round;
+    for (round = 0; round < 1000; ++round) {
+        insert_batch_end(&list, batch, 3);
+        remove_node(&list, list.last);
+        remove_node(&list, list.last);
+        remove_node(&list, list.last);
+    }
+    assert_int_equal(1, list_matches(&list, TEST_DATA, 2)
+                     && list.arena == NULL,
+                     "test_insert_batch_reclaim2");
+
+    insert_batch_end(&list, batch, 3);
+    List rest;
+    int ret = list_split_at(&list, find(&list, "x1"), &rest);
+    const char *expect[] = { "ABC0", "ABC1", "x0" };
+    assert_int_equal(1, ret == 0 && list_matches(&list, expect, 3)
+                     && list_matches(&rest, batch + 1, 2),
+                     "test_insert_batch_reclaim3");
+    dealloc_list(&rest);
+    dealloc_list(&list);
+}
+
+int node_digit_is_odd(const Node *node, void *ctx)
+{
+    (void)ctx;
+    return (node->data[node->len - 1] - '0') % 2 == 1;
+}
+
+// Matching nodes go in one pass, with the index kept in step
+void test_list_remove_if()
+{
+    List list;
+    init_list(&list, TEST_DATA, DATA_LEN);
+    list_index_attach(&list);
+    size_t removed = list_remove_if(&list, node_digit_is_odd, NULL);
+    const char *expect[] = { "ABC0", "ABC2", "ABC4", "ABC6", "ABC8" };
+    assert_int_equal(1, removed == 5 && list_matches(&list, expect, 5),
+                     "test_list_remove_if1");
+    assert_int_equal(1, find(&list, "ABC3") == NULL
+                     && find(&list, "ABC4") != NULL,
+                     "test_list_remove_if2");
+    dealloc_list(&list);
+}
+
+// Heap and pool nodes both come out; the heap ones are freed by the reaper
+void test_list_remove_if_deferred()
+{
+    NodePool pool;
+    node_pool_init(&pool);
+    List list;
+    init_list_pooled(&list, &pool, TEST_DATA, 4);
+    int i;
+    for (i = 4; i < DATA_LEN; ++i)
+        insert_end(&list, make_node(TEST_DATA[i]));
+    Reaper reaper;
+    init_reaper(&reaper);
+    size_t removed = list_remove_if_deferred(&list, node_digit_is_odd, NULL,
+                                             &reaper);
+    reaper_wait(&reaper);
+    const char *expect[] = { "ABC0", "ABC2", "ABC4", "ABC6", "ABC8" };
+    assert_int_equal(1, removed == 5 && list_matches(&list, expect, 5)
+                     && reaper.pending == NULL,
+                     "test_list_remove_if_deferred");
+    dealloc_reaper(&reaper);
+    dealloc_list(&list);
+    node_pool_dealloc(&pool);
+}
+
+// Each policy moves a hit the expected distance without losing nodes
+void test_find_adaptive()
+{
+    List list;
+    init_list(&list, TEST_DATA, 5);
+    find_adaptive(&list, "ABC3");
+    const char *unchanged[] = { "ABC0", "ABC1", "ABC2", "ABC3", "ABC4" };
+    assert_int_equal(1, list_matches(&list, unchanged, 5),
+                     "test_find_adaptive1");
+
+    list_set_organize(&list, ORGANIZE_TRANSPOSE);
+    find_adaptive(&list, "ABC3");
+    const char *transposed[] = { "ABC0", "ABC1", "ABC3", "ABC2", "ABC4" };
+    assert_int_equal(1, list_matches(&list, transposed, 5),
+                     "test_find_adaptive2");
+
+    list_set_organize(&list, ORGANIZE_MOVE_TO_FRONT);
+    find_adaptive(&list, "ABC4");
+    const char *fronted[] = { "ABC4", "ABC0", "ABC1", "ABC3", "ABC2" };
+    assert_int_equal(1, list_matches(&list, fronted, 5),
+                     "test_find_adaptive3");
+
+    list_set_organize(&list, ORGANIZE_COUNT);
+    find_adaptive(&list, "ABC2");
+    find_adaptive(&list, "ABC2");
+    find_adaptive(&list, "ABC1");
+    find_adaptive(&list, "ABC4");
+    const char *counted[] = { "ABC2", "ABC1", "ABC4", "ABC0", "ABC3" };
+    assert_int_equal(1, list_matches(&list, counted, 5),
+                     "test_find_adaptive4");
+    assert_int_equal(1, find_adaptive(&list, "zzzz") == NULL,
+                     "test_find_adaptive5");
+    dealloc_list(&list);
+}
+
+// Gets refresh entries, the least recently used one is evicted and its
+// node reused for the new entry
+void test_lru_cache()
+{
+    LruCache cache;
+    init_lru_cache(&cache, 3);
+    lru_put(&cache, "a", "1");
+    lru_put(&cache, "b", "2");
+    lru_put(&cache, "c", "3");
+    const char *value = lru_get(&cache, "a");
+    assert_int_equal(1, value != NULL && strcmp(value, "1") == 0,
+                     "test_lru_cache1");
+    Node *tail = cache.list.last;
+    lru_put(&cache, "d", "4");
+    assert_int_equal(1, lru_get(&cache, "b") == NULL
+                     && cache.list.head == tail && cache.evictions == 1,
+                     "test_lru_cache2");
+    lru_put(&cache, "c", "three");
+    value = lru_get(&cache, "c");
+    assert_int_equal(1, value != NULL && strcmp(value, "three") == 0
+                     && cache.list.size == 3,
+                     "test_lru_cache3");
+    const char *expect[] = { "c", "d", "a" };
+    assert_int_equal(1, list_matches(&cache.list, expect, 3),
+                     "test_lru_cache4");
+    assert_int_equal(1, cache.hits == 2 && cache.misses == 1,
+                     "test_lru_cache5");
+    char big[300];
+    memset(big, 'v', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    lru_put(&cache, "e", big);
+    value = lru_get(&cache, "e");
+    assert_int_equal(1, value != NULL && strlen(value) == sizeof(big) - 1
+                     && lru_get(&cache, "a") == NULL,
+                     "test_lru_cache6");
+    dealloc_lru_cache(&cache);
+}
+
+typedef struct {
+    ShardedLru lru;
+    int wrong;
+} LruTest;
+
+void *lru_test_thread(void *arg)
+{
+    LruTest *t = arg;
+    char key[16], out[16];
+    int i;
+    for (i = 0; i < 5000; ++i) {
+        snprintf(key, sizeof(key), "%d", i % 97);
+        if (sharded_lru_get(&t->lru, key, out, sizeof(out))) {
+            if (strcmp(out, key) != 0)
+                __atomic_add_fetch(&t->wrong, 1, __ATOMIC_RELAXED);
+        } else {
+            sharded_lru_put(&t->lru, key, key);
+        }
+    }
+    return NULL;
+}
+
+// Threads sharing a sharded cache only ever read back what was stored
+void test_sharded_lru()
+{
+    LruTest t;
+    init_sharded_lru(&t.lru, 64, 4);
+    t.wrong = 0;
+    pthread_t threads[3];
+    int i;
+    for (i = 0; i < 3; ++i)
+        pthread_create(&threads[i], NULL, lru_test_thread, &t);
+    for (i = 0; i < 3; ++i)
+        pthread_join(threads[i], NULL);
+    size_t size = 0;
+    for (i = 0; i < 4; ++i)
+        size += t.lru.shards[i].cache.list.size;
+    assert_int_equal(1, t.wrong == 0 && size <= 64, "test_sharded_lru");
+    dealloc_sharded_lru(&t.lru);
+}
+
+// =========== List test functions end =========== //
+
+
+// =========== Benchmark functions start =========== //
+
+#define BENCH_LIST_LEN 1024
+#define BENCH_ITERATIONS 2000000
+
+double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keep a list at a steady length by removing the head and appending a fresh
+// node, 'iterations' times. Returns operations (remove + insert) per second.
+double churn_list(List *list, NodePool *pool, int iterations)
+{
+    double start = bench_now();
+    int i;
+    for (i = 0; i < iterations; ++i) {
+        remove_node(list, list->head);
+        Node *n = pool ? node_pool_make_node(pool, TEST_DATA[i % DATA_LEN])
+                       : make_node(TEST_DATA[i % DATA_LEN]);
+        insert_end(list, n);
+    }
+    return iterations / (bench_now() - start);
+}
+
+// Insert/delete churn through make_node versus a NodePool
+void bench_node_pool_churn()
+{
+    const char *data[BENCH_LIST_LEN];
+    int i;
+    for (i = 0; i < BENCH_LIST_LEN; ++i)
+        data[i] = TEST_DATA[i % DATA_LEN];
+
+    List list;
+    init_list(&list, data, BENCH_LIST_LEN);
+    double heap_rate = churn_list(&list, NULL, BENCH_ITERATIONS);
+    dealloc_list(&list);
+
+    NodePool pool;
+    node_pool_init(&pool);
+    init_list_pooled(&list, &pool, data, BENCH_LIST_LEN);
+    double pool_rate = churn_list(&list, &pool, BENCH_ITERATIONS);
+    dealloc_list(&list);
+    node_pool_dealloc(&pool);
+
+    printf("bench_node_pool_churn: make_node %.2f Mops/s, "
+           "node pool %.2f Mops/s\n", heap_rate / 1e6, pool_rate / 1e6);
+}
+
+// xorshift64 pseudo random numbers; '*state' must not be 0
+uint64_t bench_rand(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+#define BENCH_KEY_BYTES 16
+
+// Build 'n' distinct keys "key<i>". The pointer array and the strings share
+// one allocation, released with a single free().
+const char **bench_make_keys(int n)
+{
+    const char **keys = malloc(n * (sizeof(*keys) + BENCH_KEY_BYTES));
+    if (keys == NULL)
+        return NULL;
+    char *bytes = (char *)(keys + n);
+    int i;
+    for (i = 0; i < n; ++i) {
+        keys[i] = bytes + (size_t)i * BENCH_KEY_BYTES;
+        snprintf(bytes + (size_t)i * BENCH_KEY_BYTES, BENCH_KEY_BYTES,
+                 "key%d", i);
+    }
+    return keys;
+}
+
+// Average nanoseconds per successful find of a random key in 'list'
+double time_lookups(const List *list, const char **keys, int n, int lookups)
+{
+    uint64_t seed = 88172645463325252ull;
+    double start = bench_now();
+    int i;
+    for (i = 0; i < lookups; ++i) {
+        if (find(list, keys[bench_rand(&seed) % n]) == NULL)
+            fprintf(stderr, "lookup missed\n");
+    }
+    return (bench_now() - start) / lookups * 1e9;
+}
+
+// find latency against list length, with and without a hash index
+void bench_index_find()
+{
+    int n;
+    for (n = 1000; n <= 100000; n *= 10) {
+        const char **keys = bench_make_keys(n);
+        List list;
+        init_list(&list, keys, n);
+        double linear = time_lookups(&list, keys, n, 2000);
+        list_index_attach(&list);
+        double indexed = time_lookups(&list, keys, n, 1000000);
         dealloc_list(&list);
-    assert_int_equal(0, init_ret, "test_init_list_success");
+        free(keys);
+        printf("bench_index_find: %6d nodes: walk %10.1f ns, "
+               "index %6.1f ns\n", n, linear, indexed);
+    }
+}
+
+// The original find: strcmp against every node
+Node *find_strcmp(const List *list, const char *data)
+{
+    Node *i = list->head;
+    while (i != NULL) {
+        if (strcmp(i->data, data) == 0)
+            return i;
+        i = i->next;
+    }
+    return NULL;
+}
+
+// Miss-only lookups: strcmp on every node against the cached hash and length.
+// All keys share a prefix, the worst case for strcmp.
+void bench_find_miss()
+{
+    const int n = 10000, lookups = 2000;
+    const char **keys = bench_make_keys(n);
+    List list;
+    init_list(&list, keys, n);
+    char probe[BENCH_KEY_BYTES];
+    int hits = 0;
+    int i;
+
+    double start = bench_now();
+    for (i = 0; i < lookups; ++i) {
+        snprintf(probe, sizeof(probe), "key%d", n + i);
+        hits += find_strcmp(&list, probe) != NULL;
+    }
+    double plain = (bench_now() - start) / lookups * 1e9;
+
+    start = bench_now();
+    for (i = 0; i < lookups; ++i) {
+        snprintf(probe, sizeof(probe), "key%d", n + i);
+        hits += find(&list, probe) != NULL;
+    }
+    double cached = (bench_now() - start) / lookups * 1e9;
+
+    dealloc_list(&list);
+    free(keys);
+    printf("bench_find_miss: %d nodes: strcmp %.1f ns, hash+len %.1f ns "
+           "(%d hits)\n", n, plain, cached, hits);
+}
+
+// Compare 'count' pairs of equal 'len' byte strings with 'fn'. Returns
+// nanoseconds per comparison.
+double time_bytes_equal(BytesEqualFn fn, const char *a, const char *b,
+                        size_t len, int count)
+{
+    volatile int sink = 0;
+    double start = bench_now();
+    int i;
+    for (i = 0; i < count; ++i)
+        sink += fn(a, b, len);
+    (void)sink;
+    return (bench_now() - start) / count * 1e9;
+}
+
+int bytes_equal_strcmp(const char *a, const char *b, size_t len)
+{
+    (void)len;
+    return strcmp(a, b) == 0;
+}
+
+// Equal-string comparison cost of strcmp against the vector kernels
+void bench_bytes_equal()
+{
+    static const size_t lengths[] = { 8, 32, 128, 1024 };
+    char a[1025], b[1025];
+    size_t i;
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        size_t len = lengths[i];
+        memset(a, 'x', len);
+        memset(b, 'x', len);
+        a[len] = b[len] = '\0';
+        printf("bench_bytes_equal: %4zu bytes: strcmp %6.2f ns, "
+               "scalar %6.2f ns, selected %6.2f ns\n", len,
+               time_bytes_equal(bytes_equal_strcmp, a, b, len, 5000000),
+               time_bytes_equal(bytes_equal_scalar, a, b, len, 5000000),
+               time_bytes_equal(select_bytes_equal(), a, b, len, 5000000));
+    }
+}
+
+// Full traversals (miss-only finds) of a Node chain against an unrolled list
+// holding the same strings. The chain is built in shuffled allocation order,
+// as it would be after a while of insert/remove churn.
+void bench_ulist_traverse()
+{
+    const int n = 1000000, rounds = 10;
+    const char **keys = bench_make_keys(n);
+    Node **nodes = malloc(n * sizeof(*nodes));
+    int i;
+    for (i = 0; i < n; ++i)
+        nodes[i] = make_node(keys[i]);
+    uint64_t seed = 88172645463325252ull;
+    for (i = n - 1; i > 0; --i) {
+        int j = bench_rand(&seed) % (i + 1);
+        Node *tmp = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = tmp;
+    }
+    List list;
+    init_list(&list, keys, 0);
+    for (i = 0; i < n; ++i)
+        insert_end(&list, nodes[i]);
+    free(nodes);
+
+    UList ulist;
+    init_ulist(&ulist, keys, n);
+
+    double start = bench_now();
+    for (i = 0; i < rounds; ++i)
+        find(&list, "missing");
+    double chain = (bench_now() - start) / ((double)rounds * n) * 1e9;
+    start = bench_now();
+    for (i = 0; i < rounds; ++i)
+        ulist_find(&ulist, "missing");
+    double unrolled = (bench_now() - start) / ((double)rounds * n) * 1e9;
+
+    dealloc_list(&list);
+    dealloc_ulist(&ulist);
+    free(keys);
+    printf("bench_ulist_traverse: %d strings: Node chain %.2f ns/string, "
+           "unrolled %.2f ns/string\n", n, chain, unrolled);
+}
+
+// Number of online CPUs, at least 1
+int bench_threads()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Shuffled copy of 'n' keys
+const char **bench_shuffled(const char **keys, int n, uint64_t seed)
+{
+    const char **out = malloc(n * sizeof(*out));
+    memcpy(out, keys, n * sizeof(*out));
+    int i;
+    for (i = n - 1; i > 0; --i) {
+        int j = bench_rand(&seed) % (i + 1);
+        const char *tmp = out[i];
+        out[i] = out[j];
+        out[j] = tmp;
+    }
+    return out;
+}
+
+int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Sorting 1M random strings: copy out + qsort + init_list against the
+// in-place merge sorts
+void bench_sort()
+{
+    const int n = 1 << 20;
+    const char **keys = bench_make_keys(n);
+    const char **shuffled = bench_shuffled(keys, n, 88172645463325252ull);
+    List list;
+
+    init_list(&list, shuffled, n);
+    double start = bench_now();
+    const char **copy = malloc(n * sizeof(*copy));
+    Node *i;
+    int k = 0;
+    for (i = list.head; i != NULL; i = i->next)
+        copy[k++] = i->data;
+    qsort(copy, n, sizeof(*copy), compare_strings);
+    List rebuilt;
+    init_list(&rebuilt, copy, n);
+    dealloc_list(&list);
+    double rebuild = bench_now() - start;
+    dealloc_list(&rebuilt);
+    free(copy);
+
+    init_list(&list, shuffled, n);
+    start = bench_now();
+    sort_list(&list, NULL, NULL);
+    double merge = bench_now() - start;
+    dealloc_list(&list);
+
+    WorkerPool pool;
+    worker_pool_init(&pool, bench_threads());
+    init_list(&list, shuffled, n);
+    start = bench_now();
+    sort_list_parallel(&list, NULL, NULL, &pool);
+    double parallel = bench_now() - start;
+    dealloc_list(&list);
+    worker_pool_dealloc(&pool);
+
+    free(shuffled);
+    free(keys);
+    printf("bench_sort: %d nodes: qsort+rebuild %.0f ms, sort_list %.0f ms, "
+           "sort_list_parallel (%d threads) %.0f ms\n", n, rebuild * 1e3,
+           merge * 1e3, bench_threads(), parallel * 1e3);
+}
+
+// Start 'threads' threads running 'fn' with the same 'arg' and wait for them.
+// Returns the elapsed wall time in seconds.
+double bench_run_threads(int threads, void *(*fn)(void *), void *arg)
+{
+    pthread_t *ids = malloc(threads * sizeof(*ids));
+    double start = bench_now();
+    int i;
+    for (i = 0; i < threads; ++i)
+        pthread_create(&ids[i], NULL, fn, arg);
+    for (i = 0; i < threads; ++i)
+        pthread_join(ids[i], NULL);
+    free(ids);
+    return bench_now() - start;
+}
+
+#define BENCH_RW_KEYS 1000
+#define BENCH_RW_OPS 200000
+
+// Shared state of one reader-writer benchmark run
+typedef struct {
+    RwList rw;
+    pthread_mutex_t mutex; // the global-lock baseline guards rw.list with this
+    int use_rwlock;
+    int read_percent;
+    const char **keys;
+    uint64_t seed;         // per-thread seeds are derived from this
+} RwBench;
+
+void *rw_bench_thread(void *arg)
+{
+    RwBench *b = arg;
+    uint64_t seed = __atomic_add_fetch(&b->seed, 0x9E3779B97F4A7C15ull,
+                                       __ATOMIC_RELAXED);
+    int i;
+    for (i = 0; i < BENCH_RW_OPS; ++i) {
+        uint64_t r = bench_rand(&seed);
+        const char *key = b->keys[r % BENCH_RW_KEYS];
+        int read = (int)(r >> 40) % 100 < b->read_percent;
+        if (b->use_rwlock) {
+            if (read) {
+                rwlist_contains(&b->rw, key);
+            } else {
+                rwlist_remove(&b->rw, key);
+                rwlist_insert_end(&b->rw, key);
+            }
+        } else if (read) {
+            pthread_mutex_lock(&b->mutex);
+            find(&b->rw.list, key);
+            pthread_mutex_unlock(&b->mutex);
+        } else {
+            Node *new_node = make_node(key);
+            pthread_mutex_lock(&b->mutex);
+            remove_node(&b->rw.list, find(&b->rw.list, key));
+            insert_end(&b->rw.list, new_node);
+            pthread_mutex_unlock(&b->mutex);
+        }
+    }
+    return NULL;
+}
+
+// Throughput of a global mutex against the reader-writer lock, varying the
+// read share and the thread count
+void bench_rwlist()
+{
+    static const int read_percents[] = { 50, 90, 99 };
+    const char **keys = bench_make_keys(BENCH_RW_KEYS);
+    int max_threads = 2 * bench_threads();
+    size_t r;
+    for (r = 0; r < sizeof(read_percents) / sizeof(read_percents[0]); ++r) {
+        int threads;
+        for (threads = 1; threads <= max_threads; threads *= 2) {
+            double rate[2];
+            int use_rwlock;
+            for (use_rwlock = 0; use_rwlock < 2; ++use_rwlock) {
+                RwBench b;
+                init_rwlist(&b.rw, keys, BENCH_RW_KEYS);
+                pthread_mutex_init(&b.mutex, NULL);
+                b.use_rwlock = use_rwlock;
+                b.read_percent = read_percents[r];
+                b.keys = keys;
+                b.seed = 88172645463325252ull;
+                double secs = bench_run_threads(threads, rw_bench_thread, &b);
+                rate[use_rwlock] = (double)threads * BENCH_RW_OPS / secs;
+                dealloc_rwlist(&b.rw);
+                pthread_mutex_destroy(&b.mutex);
+            }
+            printf("bench_rwlist: %2d%% reads, %2d threads: mutex %.2f Mops/s, "
+                   "rwlock %.2f Mops/s\n", read_percents[r], threads,
+                   rate[0] / 1e6, rate[1] / 1e6);
+        }
+    }
+    free(keys);
+}
+
+#define BENCH_LF_KEYS 1024
+#define BENCH_LF_OPS 200000
+
+typedef struct {
+    LfList list;
+    const char **keys;
+    uint64_t seed;
+} LfBench;
+
+// 80% contains, 10% insert, 10% remove over a fixed key range
+void *lf_bench_thread(void *arg)
+{
+    LfBench *b = arg;
+    LfThread *t = lflist_thread_register(&b->list);
+    uint64_t seed = __atomic_add_fetch(&b->seed, 0x9E3779B97F4A7C15ull,
+                                       __ATOMIC_RELAXED);
+    int i;
+    for (i = 0; i < BENCH_LF_OPS; ++i) {
+        uint64_t r = bench_rand(&seed);
+        const char *key = b->keys[r % BENCH_LF_KEYS];
+        int op = (int)(r >> 40) % 10;
+        if (op == 0)
+            lflist_insert(&b->list, t, key);
+        else if (op == 1)
+            lflist_remove(&b->list, t, key);
+        else
+            lflist_contains(&b->list, t, key);
+    }
+    lflist_thread_unregister(&b->list, t);
+    return NULL;
 }
 
-// Insert a node after list head
-void test_insert_after_head()
+// Lock-free list throughput from one thread up to every hardware thread
+void bench_lflist()
 {
+    const char **keys = bench_make_keys(BENCH_LF_KEYS);
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        LfBench b;
+        init_lflist(&b.list);
+        b.keys = keys;
+        b.seed = 88172645463325252ull;
+        LfThread *t = lflist_thread_register(&b.list);
+        int i;
+        for (i = 0; i < BENCH_LF_KEYS; i += 2)
+            lflist_insert(&b.list, t, keys[i]);
+        lflist_thread_unregister(&b.list, t);
+        double secs = bench_run_threads(threads, lf_bench_thread, &b);
+        dealloc_lflist(&b.list);
+        printf("bench_lflist: %2d threads: %.2f Mops/s\n", threads,
+               (double)threads * BENCH_LF_OPS / secs / 1e6);
+        if (threads == bench_threads())
+            break;
+    }
+    free(keys);
+}
+
+#define BENCH_RCU_KEYS 100
+#define BENCH_RCU_READS 2000000
+
+typedef struct {
     List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_after(&list, list.head, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_after_head");
+    RcuDomain domain;
+    RwList rw;
+    int use_rcu;
+    const char **keys;
+    uint64_t seed;
+    int stop;
+} RcuBench;
+
+void *rcu_bench_reader(void *arg)
+{
+    RcuBench *b = arg;
+    RcuThread *t = b->use_rcu ? rcu_thread_register(&b->domain) : NULL;
+    uint64_t seed = __atomic_add_fetch(&b->seed, 0x9E3779B97F4A7C15ull,
+                                       __ATOMIC_RELAXED);
+    int i;
+    for (i = 0; i < BENCH_RCU_READS; ++i) {
+        const char *key = b->keys[bench_rand(&seed) % BENCH_RCU_KEYS];
+        if (b->use_rcu) {
+            find_concurrent(&b->list, key);
+            if (i % 64 == 0)
+                rcu_quiescent(&b->domain, t);
+        } else {
+            rwlist_contains(&b->rw, key);
+        }
+    }
+    rcu_thread_unregister(t);
+    return NULL;
 }
 
-// Insert a node after a node somewhere in the middle of a list
-void test_insert_after_middle()
+// Rewrites one config entry every millisecond until told to stop
+void *rcu_bench_writer(void *arg)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *mid = list.head->next->next->next->next; // ABC4
-    int ins_ret = insert_after(&list, mid, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_after_middle");
+    RcuBench *b = arg;
+    struct timespec pause = { 0, 1000000 };
+    int i = 0;
+    while (!__atomic_load_n(&b->stop, __ATOMIC_ACQUIRE)) {
+        const char *key = b->keys[i++ % BENCH_RCU_KEYS];
+        if (b->use_rcu) {
+            Node *fresh = make_node(key);
+            rcu_write_lock(&b->domain);
+            remove_node_rcu(&b->domain, find(&b->list, key));
+            insert_end(&b->list, fresh);
+            rcu_write_unlock(&b->domain);
+            if (rcu_reclaim_due(&b->domain))
+                rcu_reclaim(&b->domain);
+        } else {
+            rwlist_remove(&b->rw, key);
+            rwlist_insert_end(&b->rw, key);
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
 }
 
-// Insert a node after list last
-void test_insert_after_last()
+// Read throughput of a read-mostly list under RCU against the reader-writer
+// lock, from one reader up to every hardware thread
+void bench_rcu()
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_after(&list, list.last, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_after_last");
+    const char **keys = bench_make_keys(BENCH_RCU_KEYS);
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        double rate[2];
+        int use_rcu;
+        for (use_rcu = 0; use_rcu < 2; ++use_rcu) {
+            RcuBench b;
+            init_list(&b.list, keys, BENCH_RCU_KEYS);
+            init_rcu_domain(&b.domain, &b.list);
+            init_rwlist(&b.rw, keys, BENCH_RCU_KEYS);
+            b.use_rcu = use_rcu;
+            b.keys = keys;
+            b.seed = 88172645463325252ull;
+            b.stop = 0;
+            pthread_t writer;
+            pthread_create(&writer, NULL, rcu_bench_writer, &b);
+            double secs = bench_run_threads(threads, rcu_bench_reader, &b);
+            __atomic_store_n(&b.stop, 1, __ATOMIC_RELEASE);
+            pthread_join(writer, NULL);
+            rcu_reclaim(&b.domain);
+            rate[use_rcu] = (double)threads * BENCH_RCU_READS / secs;
+            dealloc_rcu_domain(&b.domain);
+            dealloc_list(&b.list);
+            dealloc_rwlist(&b.rw);
+        }
+        printf("bench_rcu: %2d readers: rwlock %.2f Mreads/s, "
+               "rcu %.2f Mreads/s\n", threads, rate[0] / 1e6, rate[1] / 1e6);
+        if (threads == bench_threads())
+            break;
+    }
+    free(keys);
 }
 
-// Insert a node before list head
-void test_insert_before_head()
+#define BENCH_APPENDS 200000
+
+typedef struct {
+    ShardedList sharded;
+    List list;                // single-lock baseline
+    pthread_mutex_t lock;
+    int use_shards;
+    int next_thread;
+} AppendBench;
+
+void *append_bench_thread(void *arg)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_before(&list, list.head, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_before_head");
+    AppendBench *b = arg;
+    int id = __atomic_fetch_add(&b->next_thread, 1, __ATOMIC_RELAXED);
+    char buf[32];
+    int i;
+    for (i = 0; i < BENCH_APPENDS; ++i) {
+        snprintf(buf, sizeof(buf), "t%d-%d", id, i);
+        if (b->use_shards) {
+            sharded_insert(&b->sharded, buf);
+        } else {
+            Node *n = make_node(buf);
+            pthread_mutex_lock(&b->lock);
+            insert_end(&b->list, n);
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+    return NULL;
 }
 
-// Insert a node before a node somewhere in the middle of a list
-void test_insert_before_middle()
+// Append throughput of one locked list against a list sharded per CPU
+void bench_sharded_append()
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *mid = list.head->next->next->next->next; // ABC4
-    int ins_ret = insert_before(&list, mid, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_before_middle");
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        double rate[2];
+        int use_shards;
+        for (use_shards = 0; use_shards < 2; ++use_shards) {
+            AppendBench b;
+            init_sharded_list(&b.sharded, 0);
+            init_empty_list(&b.list);
+            pthread_mutex_init(&b.lock, NULL);
+            b.use_shards = use_shards;
+            b.next_thread = 0;
+            double secs = bench_run_threads(threads, append_bench_thread, &b);
+            rate[use_shards] = (double)threads * BENCH_APPENDS / secs;
+            dealloc_sharded_list(&b.sharded);
+            dealloc_list(&b.list);
+            pthread_mutex_destroy(&b.lock);
+        }
+        printf("bench_sharded_append: %2d threads: one lock %.2f Mops/s, "
+               "sharded %.2f Mops/s\n", threads, rate[0] / 1e6,
+               rate[1] / 1e6);
+        if (threads == bench_threads())
+            break;
+    }
 }
 
-// Insert a node before list last
-void test_insert_before_last()
+#define BENCH_QUEUE_ITEMS 200000
+#define BENCH_QUEUE_BATCH 16
+
+typedef struct {
+    WorkQueue q;
+    List list;                // single-lock baseline
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    int closed;
+    int use_wq;
+    int producers;            // the first 'producers' threads produce
+    int producers_left;
+    int next_thread;
+    double *latency;          // per item, when measuring latency
+} QueueBench;
+
+// Producers push timestamped items; the last one to finish closes the queue.
+// Consumers drain until the queue is closed and empty.
+void *queue_bench_thread(void *arg)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_before(&list, list.last, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_before_last");
+    QueueBench *b = arg;
+    int id = __atomic_fetch_add(&b->next_thread, 1, __ATOMIC_RELAXED);
+    char buf[32];
+    if (id < b->producers) {
+        int i;
+        for (i = 0; i < BENCH_QUEUE_ITEMS; ++i) {
+            snprintf(buf, sizeof(buf), "%d %.9f", i, bench_now());
+            if (b->use_wq) {
+                wq_push(&b->q, buf);
+            } else {
+                Node *n = make_node(buf);
+                pthread_mutex_lock(&b->lock);
+                insert_end(&b->list, n);
+                pthread_cond_signal(&b->nonempty);
+                pthread_mutex_unlock(&b->lock);
+            }
+        }
+        if (__atomic_sub_fetch(&b->producers_left, 1, __ATOMIC_ACQ_REL) == 0) {
+            wq_close(&b->q);
+            pthread_mutex_lock(&b->lock);
+            b->closed = 1;
+            pthread_cond_broadcast(&b->nonempty);
+            pthread_mutex_unlock(&b->lock);
+        }
+        return NULL;
+    }
+    for (;;) {
+        char *batch[BENCH_QUEUE_BATCH];
+        size_t count = 0;
+        if (b->use_wq) {
+            count = wq_pop_batch(&b->q, batch, BENCH_QUEUE_BATCH, 1);
+        } else {
+            pthread_mutex_lock(&b->lock);
+            while (b->list.head == NULL && !b->closed)
+                pthread_cond_wait(&b->nonempty, &b->lock);
+            while (b->list.head != NULL && count < BENCH_QUEUE_BATCH) {
+                Node *n = b->list.head;
+                unlink_node(&b->list, n);
+                batch[count++] = n->data;
+                free(n);
+            }
+            pthread_mutex_unlock(&b->lock);
+        }
+        if (count == 0)
+            return NULL;
+        double now = bench_now();
+        size_t i;
+        for (i = 0; i < count; ++i) {
+            char *stamp;
+            long item = strtol(batch[i], &stamp, 10);
+            if (b->latency != NULL)
+                b->latency[item] = now - strtod(stamp, NULL);
+            free(batch[i]);
+        }
+    }
 }
 
-// Test call to insert_front
-void test_insert_front_success()
+// Run 'producers' producers and 'consumers' consumers over a work queue or
+// the locked list baseline. Returns items per second.
+double run_queue_bench(QueueBench *b, int use_wq, int producers,
+                       int consumers)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_front(&list, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_front_success");
+    init_work_queue(&b->q);
+    init_empty_list(&b->list);
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->nonempty, NULL);
+    b->closed = 0;
+    b->use_wq = use_wq;
+    b->producers = producers;
+    b->producers_left = producers;
+    b->next_thread = 0;
+    double secs = bench_run_threads(producers + consumers, queue_bench_thread,
+                                    b);
+    dealloc_work_queue(&b->q);
+    dealloc_list(&b->list);
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->nonempty);
+    return (double)producers * BENCH_QUEUE_ITEMS / secs;
 }
 
-// Test call to insert_end
-void test_insert_end_success()
+int compare_doubles(const void *a, const void *b)
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int ins_ret = insert_end(&list, make_node("zzzz"));
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, ins_ret, "test_insert_end_success");
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
 }
 
-// Remove the list head
-void test_remove_node_head()
+// Hand-off throughput of the two-lock work queue against a list behind one
+// mutex with growing producer/consumer pairs, then the work queue's latency
+// percentiles with one producer and one consumer
+void bench_work_queue()
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int rem_ret = remove_node(&list, list.head);
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, rem_ret, "test_remove_node_head");
+    QueueBench b;
+    b.latency = NULL;
+    int pairs;
+    for (pairs = 1; ; pairs *= 2) {
+        if (pairs > bench_threads() / 2)
+            pairs = bench_threads() / 2 > 0 ? bench_threads() / 2 : 1;
+        double locked = run_queue_bench(&b, 0, pairs, pairs);
+        double two_lock = run_queue_bench(&b, 1, pairs, pairs);
+        printf("bench_work_queue: %2d producers/consumers: one lock "
+               "%.2f Mitems/s, work queue %.2f Mitems/s\n", pairs,
+               locked / 1e6, two_lock / 1e6);
+        if (pairs * 2 >= bench_threads())
+            break;
+    }
+
+    b.latency = malloc(BENCH_QUEUE_ITEMS * sizeof(*b.latency));
+    run_queue_bench(&b, 1, 1, 1);
+    qsort(b.latency, BENCH_QUEUE_ITEMS, sizeof(*b.latency), compare_doubles);
+    printf("bench_work_queue: latency p50 %.2f us, p99 %.2f us, "
+           "max %.2f us\n", b.latency[BENCH_QUEUE_ITEMS / 2] * 1e6,
+           b.latency[BENCH_QUEUE_ITEMS / 100 * 99] * 1e6,
+           b.latency[BENCH_QUEUE_ITEMS - 1] * 1e6);
+    free(b.latency);
 }
 
-// Remove a node in the middle
-void test_remove_node_middle()
+#define BENCH_HLIST_KEYS 256
+#define BENCH_HLIST_OPS 20000
+
+typedef struct {
+    HList hlist;
+    List list;                // single-lock baseline
+    pthread_mutex_t lock;
+    const char **keys;
+    int use_coupling;
+    int next_thread;
+    uint64_t seed;
+} HListBench;
+
+// Insert a thread-private string next to a random key, then remove it again
+void *hlist_bench_thread(void *arg)
+{
+    HListBench *b = arg;
+    int id = __atomic_fetch_add(&b->next_thread, 1, __ATOMIC_RELAXED);
+    uint64_t seed = __atomic_add_fetch(&b->seed, 0x9E3779B97F4A7C15ull,
+                                       __ATOMIC_RELAXED);
+    char tag[16];
+    snprintf(tag, sizeof(tag), "tag%d", id);
+    int i;
+    for (i = 0; i < BENCH_HLIST_OPS; ++i) {
+        const char *key = b->keys[bench_rand(&seed) % BENCH_HLIST_KEYS];
+        if (b->use_coupling) {
+            hlist_insert_after(&b->hlist, key, tag);
+            hlist_remove(&b->hlist, tag);
+        } else {
+            Node *new_node = make_node(tag);
+            pthread_mutex_lock(&b->lock);
+            insert_after(&b->list, find(&b->list, key), new_node);
+            remove_node(&b->list, find(&b->list, tag));
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+    return NULL;
+}
+
+// Insert/remove throughput at random positions of a list behind one mutex
+// against the lock-coupled list
+void bench_hlist()
+{
+    const char **keys = bench_make_keys(BENCH_HLIST_KEYS);
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        double rate[2];
+        int use_coupling;
+        for (use_coupling = 0; use_coupling < 2; ++use_coupling) {
+            HListBench b;
+            init_hlist(&b.hlist);
+            init_list(&b.list, keys, BENCH_HLIST_KEYS);
+            int i;
+            for (i = BENCH_HLIST_KEYS - 1; i >= 0; --i)
+                hlist_insert_front(&b.hlist, keys[i]);
+            pthread_mutex_init(&b.lock, NULL);
+            b.keys = keys;
+            b.use_coupling = use_coupling;
+            b.next_thread = 0;
+            b.seed = 88172645463325252ull;
+            double secs = bench_run_threads(threads, hlist_bench_thread, &b);
+            rate[use_coupling] = (double)threads * BENCH_HLIST_OPS / secs;
+            dealloc_hlist(&b.hlist);
+            dealloc_list(&b.list);
+            pthread_mutex_destroy(&b.lock);
+        }
+        printf("bench_hlist: %2d threads: one lock %.2f Kops/s, "
+               "lock coupling %.2f Kops/s\n", threads, rate[0] / 1e3,
+               rate[1] / 1e3);
+        if (threads == bench_threads())
+            break;
+    }
+    free(keys);
+}
+
+#define BENCH_FIND_PARALLEL_LEN (1 << 20)
+
+// Time 'count' finds of 'key' with find_parallel, or find if 'pool' is
+// NULL. Returns milliseconds per find.
+double time_find_parallel(List *list, const char *key, WorkerPool *pool,
+                          int count)
 {
+    volatile Node *sink = NULL;
+    double start = bench_now();
+    int i;
+    for (i = 0; i < count; ++i)
+        sink = pool ? find_parallel(list, key, pool) : find(list, key);
+    (void)sink;
+    return (bench_now() - start) / count * 1e3;
+}
+
+// Sequential find against find_parallel on a million-node list, for a key
+// near the end and for a miss
+void bench_find_parallel()
+{
+    const char **keys = bench_make_keys(BENCH_FIND_PARALLEL_LEN);
     List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *mid = list.head->next->next->next->next; // ABC4
-    int rem_ret = remove_node(&list, mid);
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, rem_ret, "test_remove_node_middle");
+    init_list(&list, keys, BENCH_FIND_PARALLEL_LEN);
+    list_checkpoints_attach(&list, 4096);
+    WorkerPool pool;
+    worker_pool_init(&pool, bench_threads());
+    const char *last = keys[BENCH_FIND_PARALLEL_LEN - 1];
+    printf("bench_find_parallel: %d workers: last key: find %.2f ms, "
+           "parallel %.2f ms\n", pool.count,
+           time_find_parallel(&list, last, NULL, 20),
+           time_find_parallel(&list, last, &pool, 20));
+    printf("bench_find_parallel: %d workers: miss: find %.2f ms, "
+           "parallel %.2f ms\n", pool.count,
+           time_find_parallel(&list, "missing", NULL, 20),
+           time_find_parallel(&list, "missing", &pool, 20));
+    worker_pool_dealloc(&pool);
+    dealloc_list(&list);
+    free(keys);
 }
 
-// Remove the list last
-void test_remove_node_last()
+#define BENCH_FOR_EACH_LEN 100000
+
+// Stand-in for CPU-heavy per-string work: rehash the string many times
+void bench_heavy_visit(const Node *node, void *ctx)
+{
+    uint32_t h = node->hash;
+    int i;
+    for (i = 0; i < 64; ++i)
+        h = hash_bytes(node->data, node->len) ^ (h * 31);
+    __atomic_add_fetch((uint32_t *)ctx, h, __ATOMIC_RELAXED);
+}
+
+// list_for_each against list_for_each_parallel for a heavy callback
+void bench_for_each()
 {
+    const char **keys = bench_make_keys(BENCH_FOR_EACH_LEN);
     List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    int rem_ret = remove_node(&list, list.last);
-    test_print_list(&list);
-    if (init_ret == 0)
-        dealloc_list(&list);
-    assert_int_equal(0, rem_ret, "test_remove_node_last");
+    init_list(&list, keys, BENCH_FOR_EACH_LEN);
+    WorkerPool pool;
+    worker_pool_init(&pool, bench_threads());
+    uint32_t sink = 0;
+    double start = bench_now();
+    list_for_each(&list, bench_heavy_visit, &sink);
+    double seq = bench_now() - start;
+    start = bench_now();
+    list_for_each_parallel(&list, bench_heavy_visit, &sink, &pool);
+    double par = bench_now() - start;
+    printf("bench_for_each: %d workers: sequential %.2f ms, "
+           "parallel %.2f ms\n", pool.count, seq * 1e3, par * 1e3);
+    worker_pool_dealloc(&pool);
+    dealloc_list(&list);
+    free(keys);
 }
 
-// Test find function when node is list head
-void test_find_head()
+#define BENCH_CACHE_OPS 500000
+#define BENCH_CACHE_LIVE 64
+
+typedef struct {
+    const char **keys;
+    int use_cache;
+} CacheBench;
+
+// Churn a private list: drop the head, append a fresh node
+void *cache_bench_thread(void *arg)
 {
+    CacheBench *b = arg;
     List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *t = find(&list, "ABC0");
+    init_empty_list(&list);
+    int i;
+    for (i = 0; i < BENCH_CACHE_OPS; ++i) {
+        const char *key = b->keys[i % BENCH_CACHE_LIVE];
+        insert_end(&list, b->use_cache ? make_node_cached(key)
+                                       : make_node(key));
+        if (list.size > BENCH_CACHE_LIVE)
+            remove_node(&list, list.head);
+    }
+    dealloc_list(&list);
+    return NULL;
+}
 
-    assert_node_ptr_equal(NULL, t->prev, "test_find_head1");
-    assert_node_ptr_equal(list.head->next, t->next, "test_find_head2");
-    assert_int_equal(0, strcmp("ABC0", t->data), "test_find_head3");
+// Node churn on every thread at once with malloc'd nodes against the
+// per-thread node caches
+void bench_node_cache()
+{
+    CacheBench b;
+    b.keys = bench_make_keys(BENCH_CACHE_LIVE);
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        double rate[2];
+        for (b.use_cache = 0; b.use_cache < 2; ++b.use_cache) {
+            double secs = bench_run_threads(threads, cache_bench_thread, &b);
+            rate[b.use_cache] = (double)threads * BENCH_CACHE_OPS / secs;
+        }
+        printf("bench_node_cache: %2d threads: malloc %.2f Mops/s, "
+               "node cache %.2f Mops/s\n", threads, rate[0] / 1e6,
+               rate[1] / 1e6);
+        if (threads == bench_threads())
+            break;
+    }
+    node_cache_flush();
+    node_cache_trim();
+    free(b.keys);
+}
 
-    if (init_ret == 0)
+#define BENCH_BATCH_LEN 64
+#define BENCH_BATCH_ROUNDS 20000
+
+// Build and tear down lists of BENCH_BATCH_LEN strings, inserting them one
+// node at a time or as one batch. Returns nanoseconds per string.
+double time_batch_insert(const char **keys, int batched)
+{
+    double start = bench_now();
+    int r;
+    for (r = 0; r < BENCH_BATCH_ROUNDS; ++r) {
+        List list;
+        init_empty_list(&list);
+        if (batched) {
+            insert_batch_end(&list, keys, BENCH_BATCH_LEN);
+        } else {
+            int i;
+            for (i = 0; i < BENCH_BATCH_LEN; ++i)
+                insert_end(&list, make_node(keys[i]));
+        }
         dealloc_list(&list);
+    }
+    return (bench_now() - start) / BENCH_BATCH_ROUNDS / BENCH_BATCH_LEN * 1e9;
 }
 
-// Test find function when node is somewhere in the middle
-void test_find_middle()
+// Per-element make_node + insert_end against insert_batch_end
+void bench_insert_batch()
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *t = find(&list, "ABC4");
+    const char **keys = bench_make_keys(BENCH_BATCH_LEN);
+    printf("bench_insert_batch: %d strings: per element %.2f ns, "
+           "batch %.2f ns per string\n", BENCH_BATCH_LEN,
+           time_batch_insert(keys, 0), time_batch_insert(keys, 1));
+    free(keys);
+}
 
-    Node *mid = list.head->next->next->next->next; // ABC4
-    assert_node_ptr_equal(mid->prev, t->prev, "test_find_middle1");
-    assert_node_ptr_equal(mid->next, t->next, "test_find_middle2");
-    assert_int_equal(0, strcmp("ABC4", t->data), "test_find_middle3");
+#define BENCH_REMOVE_IF_LEN 1000000
 
-    if (init_ret == 0)
-        dealloc_list(&list);
+int bench_key_is_odd(const Node *node, void *ctx)
+{
+    (void)ctx;
+    return node->data[node->len - 1] % 2 == 1;
 }
 
-// Test find function when node is list last
-void test_find_last()
+// Caller-side time to remove half of a large list with list_remove_if
+// against handing the frees to a reaper
+void bench_remove_if()
 {
-    List list;
-    int init_ret = init_list(&list, TEST_DATA, DATA_LEN);
-    Node *t = find(&list, "ABC9");
+    const char **keys = bench_make_keys(BENCH_REMOVE_IF_LEN);
+    Reaper reaper;
+    init_reaper(&reaper);
+    // Both lists are built up front so that neither walks recycled memory
+    List lists[2];
+    init_list(&lists[0], keys, BENCH_REMOVE_IF_LEN);
+    init_list(&lists[1], keys, BENCH_REMOVE_IF_LEN);
+    double ms[2];
+    int deferred;
+    for (deferred = 0; deferred < 2; ++deferred) {
+        double start = bench_now();
+        if (deferred)
+            list_remove_if_deferred(&lists[1], bench_key_is_odd, NULL,
+                                    &reaper);
+        else
+            list_remove_if(&lists[0], bench_key_is_odd, NULL);
+        ms[deferred] = (bench_now() - start) * 1e3;
+        reaper_wait(&reaper);
+    }
+    dealloc_list(&lists[0]);
+    dealloc_list(&lists[1]);
+    printf("bench_remove_if: %d nodes, half removed: freeing inline "
+           "%.2f ms, deferred %.2f ms\n", BENCH_REMOVE_IF_LEN, ms[0], ms[1]);
+    dealloc_reaper(&reaper);
+    free(keys);
+}
 
-    assert_node_ptr_equal(list.last->prev, t->prev, "test_find_last1");
-    assert_node_ptr_equal(NULL, t->next, "test_find_last2");
-    assert_int_equal(0, strcmp("ABC9", t->data), "test_find_last3");
+#define BENCH_ZIPF_KEYS 1024
+#define BENCH_ZIPF_LOOKUPS 1000000
 
-    if (init_ret == 0)
+// Draw a rank in [0, n) with probability proportional to 1 / (rank + 1),
+// given the cumulative weights in 'cdf'
+int zipf_sample(const double *cdf, int n, uint64_t *seed)
+{
+    double u = (bench_rand(seed) >> 11) * (1.0 / 9007199254740992.0)
+               * cdf[n - 1];
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Lookup cost of find against find_adaptive under each policy, for Zipf
+// distributed lookups whose popular keys start out scattered over the list
+void bench_find_adaptive()
+{
+    static const char *names[] = { "none", "move-to-front", "transpose",
+                                   "count" };
+    const char **keys = bench_make_keys(BENCH_ZIPF_KEYS);
+    double *cdf = malloc(BENCH_ZIPF_KEYS * sizeof(*cdf));
+    const char **lookups = malloc(BENCH_ZIPF_LOOKUPS * sizeof(*lookups));
+    const char **by_rank = bench_shuffled(keys, BENCH_ZIPF_KEYS,
+                                          0x9E3779B97F4A7C15ull);
+    double total = 0;
+    int i;
+    for (i = 0; i < BENCH_ZIPF_KEYS; ++i) {
+        total += 1.0 / (i + 1);
+        cdf[i] = total;
+    }
+    uint64_t seed = 88172645463325252ull;
+    for (i = 0; i < BENCH_ZIPF_LOOKUPS; ++i)
+        lookups[i] = by_rank[zipf_sample(cdf, BENCH_ZIPF_KEYS, &seed)];
+
+    int policy;
+    for (policy = ORGANIZE_NONE; policy <= ORGANIZE_COUNT; ++policy) {
+        List list;
+        init_list(&list, keys, BENCH_ZIPF_KEYS);
+        list_set_organize(&list, policy);
+        double start = bench_now();
+        for (i = 0; i < BENCH_ZIPF_LOOKUPS; ++i)
+            find_adaptive(&list, lookups[i]);
+        printf("bench_find_adaptive: %-13s %6.2f ns per lookup\n",
+               names[policy],
+               (bench_now() - start) / BENCH_ZIPF_LOOKUPS * 1e9);
         dealloc_list(&list);
+    }
+    free(by_rank);
+    free(lookups);
+    free(cdf);
+    free(keys);
 }
 
-// =========== List test functions end =========== //
+#define BENCH_LRU_KEYS 100000
+#define BENCH_LRU_OPS 1000000
+
+typedef struct {
+    ShardedLru lru;
+    const char **stream; // Zipf distributed keys
+    int next_thread;
+} LruBench;
+
+// Get-or-put over this thread's slice of the key stream
+void *lru_bench_thread(void *arg)
+{
+    LruBench *b = arg;
+    int id = __atomic_fetch_add(&b->next_thread, 1, __ATOMIC_RELAXED);
+    char out[BENCH_KEY_BYTES];
+    int i;
+    for (i = 0; i < BENCH_LRU_OPS; ++i) {
+        const char *key = b->stream[(id * 7919 + i) % BENCH_LRU_OPS];
+        if (!sharded_lru_get(&b->lru, key, out, sizeof(out)))
+            sharded_lru_put(&b->lru, key, key);
+    }
+    return NULL;
+}
+
+// Hit rate of the LRU cache at a few capacities for Zipf distributed keys,
+// then get-or-put throughput with one lock against one shard per CPU
+void bench_lru()
+{
+    const char **keys = bench_make_keys(BENCH_LRU_KEYS);
+    const char **by_rank = bench_shuffled(keys, BENCH_LRU_KEYS,
+                                          0x9E3779B97F4A7C15ull);
+    double *cdf = malloc(BENCH_LRU_KEYS * sizeof(*cdf));
+    const char **stream = malloc(BENCH_LRU_OPS * sizeof(*stream));
+    double total = 0;
+    int i;
+    for (i = 0; i < BENCH_LRU_KEYS; ++i) {
+        total += 1.0 / (i + 1);
+        cdf[i] = total;
+    }
+    uint64_t seed = 88172645463325252ull;
+    for (i = 0; i < BENCH_LRU_OPS; ++i)
+        stream[i] = by_rank[zipf_sample(cdf, BENCH_LRU_KEYS, &seed)];
+
+    static const size_t capacities[] = { 1000, 10000, 50000 };
+    size_t c;
+    for (c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c) {
+        LruCache cache;
+        init_lru_cache(&cache, capacities[c]);
+        double start = bench_now();
+        for (i = 0; i < BENCH_LRU_OPS; ++i) {
+            if (lru_get(&cache, stream[i]) == NULL)
+                lru_put(&cache, stream[i], stream[i]);
+        }
+        double secs = bench_now() - start;
+        printf("bench_lru: capacity %5zu: hit rate %.1f%%, %.2f Mops/s\n",
+               capacities[c], 100.0 * cache.hits / BENCH_LRU_OPS,
+               BENCH_LRU_OPS / secs / 1e6);
+        dealloc_lru_cache(&cache);
+    }
 
-int main()
+    int threads;
+    for (threads = 1; ; threads *= 2) {
+        if (threads > bench_threads())
+            threads = bench_threads();
+        double rate[2];
+        int sharded;
+        for (sharded = 0; sharded < 2; ++sharded) {
+            LruBench b;
+            init_sharded_lru(&b.lru, 10000, sharded ? 0 : 1);
+            b.stream = stream;
+            b.next_thread = 0;
+            double secs = bench_run_threads(threads, lru_bench_thread, &b);
+            rate[sharded] = (double)threads * BENCH_LRU_OPS / secs;
+            dealloc_sharded_lru(&b.lru);
+        }
+        printf("bench_lru: %2d threads: one lock %.2f Mops/s, "
+               "sharded %.2f Mops/s\n", threads, rate[0] / 1e6,
+               rate[1] / 1e6);
+        if (threads == bench_threads())
+            break;
+    }
+    free(stream);
+    free(cdf);
+    free(by_rank);
+    free(keys);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} Benchmark;
+
+const Benchmark BENCHMARKS[] = {
+    { "node_pool", bench_node_pool_churn },
+    { "index", bench_index_find },
+    { "find_miss", bench_find_miss },
+    { "bytes_equal", bench_bytes_equal },
+    { "ulist", bench_ulist_traverse },
+    { "sort", bench_sort },
+    { "rwlist", bench_rwlist },
+    { "lflist", bench_lflist },
+    { "rcu", bench_rcu },
+    { "sharded", bench_sharded_append },
+    { "work_queue", bench_work_queue },
+    { "hlist", bench_hlist },
+    { "find_parallel", bench_find_parallel },
+    { "for_each", bench_for_each },
+    { "node_cache", bench_node_cache },
+    { "insert_batch", bench_insert_batch },
+    { "remove_if", bench_remove_if },
+    { "find_adaptive", bench_find_adaptive },
+    { "lru", bench_lru }
+};
+
+// Run every benchmark, or only those named in 'names'
+void run_benchmarks(int count, char *names[])
 {
+    size_t i;
+    for (i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); ++i) {
+        int selected = count == 0;
+        int j;
+        for (j = 0; j < count; ++j) {
+            if (strcmp(names[j], BENCHMARKS[i].name) == 0)
+                selected = 1;
+        }
+        if (selected)
+            BENCHMARKS[i].run();
+    }
+}
+
+// =========== Benchmark functions end =========== //
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        run_benchmarks(argc - 2, argv + 2);
+        return 0;
+    }
+
     if (isatty(STDERR_FILENO)) {
         printf("==== Running list_lib test suite... suggest redirecting stderr"
                " to /dev/null during tests ====\n\n");
@@ -541,5 +8728,59 @@ int main()
     test_find_head();
     test_find_middle();
     test_find_last();
+    test_node_pool_recycle();
+    test_node_pool_null_pool();
+    test_make_node_inline();
+    test_inline_node_find_remove();
+    test_index_find();
+    test_index_find_duplicate();
+    test_init_list_arena();
+    test_arena_remove_and_insert();
+    test_node_key_cached();
+    test_find_prefix_key();
+    test_bytes_equal_kernels();
+    test_find_prefix();
+    test_ulist_insert_split();
+    test_ulist_remove_all();
+    test_clist_insert_remove();
+    test_clist_compact();
+    test_list_length();
+    test_list_at_walk();
+    test_skip_insert_at();
+    test_skip_remove_at();
+    test_sort_list_stable();
+    test_sort_list_parallel();
+    test_rwlist_basic();
+    test_rwlist_threads();
+    test_lflist_basic();
+    test_lflist_retire_deferred();
+    test_lflist_stress();
+    test_epoch_concurrent_remove();
+    test_rcu_concurrent_remove();
+    test_rcu_offline_reader();
+    test_sharded_list();
+    test_work_queue_fifo();
+    test_work_queue_threads();
+    test_hlist_basic();
+    test_hlist_threads();
+    test_find_parallel();
+    test_list_for_each();
+    test_list_map();
+    test_node_cache_reuse();
+    test_node_cache_depot();
+    test_node_cache_free_only_thread();
+    test_list_splice();
+    test_list_splice_same_list();
+    test_list_splice_n();
+    test_list_concat();
+    test_list_split_at();
+    test_insert_batch_after();
+    test_insert_batch_end();
+    test_insert_batch_reclaim();
+    test_list_remove_if();
+    test_list_remove_if_deferred();
+    test_find_adaptive();
+    test_lru_cache();
+    test_sharded_lru();
     return 0;
 }